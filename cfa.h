@@ -0,0 +1,116 @@
+#ifndef CFA_H
+#define CFA_H
+
+///////////////////////////////////////////////
+/// color filter array of sensor (2x2 quad, name is read by rows)
+///
+
+namespace cfa{
+
+enum PATTERN{
+	RGGB,
+	BGGR,
+	GRBG,		/// layout of reference version of demoscaling
+	GBRG
+};
+
+enum COLOR{
+	RED,
+	GREEN,
+	BLUE
+};
+
+/// pixels around frame which kernels read (5x5 neighbourhood of rows around tile of AHD).
+/// they are mirror of frame with the same parity, so pattern continues over border
+enum{
+	HALO = 5
+};
+
+/**
+ * @brief The Layout struct
+ * layout of pattern P known at compile time,
+ * kernels are instantiated for every pattern, so there are no checks of parity inside loops
+ */
+template< int P >
+struct Layout{
+	enum{
+		/// position of red in quad
+		RED_ROW = (P == RGGB || P == GRBG)? 0 : 1,
+		RED_COL = (P == RGGB || P == GBRG)? 0 : 1,
+		/// phase relative to GRBG: P(y, x) == GRBG(y + DY, x + DX)
+		DY = RED_ROW,
+		DX = RED_COL ^ 1
+	};
+	/// color of pixel (y, x), for kernels where offsets are not known at compile time
+	static inline int color(int y, int x){
+		const bool red_row = ((y ^ RED_ROW) & 1) == 0;
+		const bool red_col = ((x ^ RED_COL) & 1) == 0;
+		return red_row? (red_col? RED : GREEN) : (red_col? GREEN : BLUE);
+	}
+	/// color of pixel with parity of row Y and column X
+	template< int Y, int X >
+	struct Color{
+		enum{
+			value = ((Y ^ RED_ROW) & 1)? (((X ^ RED_COL) & 1)? BLUE : GREEN)
+									   : (((X ^ RED_COL) & 1)? GREEN : RED)
+		};
+	};
+};
+
+/**
+ * @brief interpolate
+ * bilinear interpolation of pixel with parity of row Y and column X:
+ * own color as is, green by 5 points (with diagonals) on green pixels and by cross on others,
+ * red and blue on green pixels by row or column, on each other by diagonals
+ * @param s - s(di, dj) is value of neighbour pixel
+ */
+template< int P, int Y, int X, typename S >
+inline void interpolate(const S& s, int& red, int& green, int& blue)
+{
+	typedef Layout< P > L;
+	const int color = L::template Color< Y, X >::value;
+	const bool red_row = ((Y ^ L::RED_ROW) & 1) == 0;
+
+	if(color == GREEN){
+		green = (s(0, 0) + s(-1, -1) + s(-1, 1) + s(1, -1) + s(1, 1)) / 5;
+		int hor = (s(0, -1) + s(0, 1)) >> 1;
+		int ver = (s(-1, 0) + s(1, 0)) >> 1;
+		red = red_row? hor : ver;
+		blue = red_row? ver : hor;
+	}else{
+		int own = s(0, 0);
+		int diag = (s(-1, -1) + s(-1, 1) + s(1, -1) + s(1, 1)) >> 2;
+		green = (s(-1, 0) + s(0, -1) + s(0, 1) + s(1, 0)) >> 2;
+		red = color == RED? own : diag;
+		blue = color == RED? diag : own;
+	}
+}
+
+/// color of pixel (y, x) of pattern known at run time (statistics, not kernels)
+inline COLOR color(PATTERN pattern, int y, int x)
+{
+	const int red_row = (pattern == RGGB || pattern == GRBG)? 0 : 1;
+	const int red_col = (pattern == RGGB || pattern == GBRG)? 0 : 1;
+	const bool is_red_row = ((y ^ red_row) & 1) == 0;
+	const bool is_red_col = ((x ^ red_col) & 1) == 0;
+	return is_red_row? (is_red_col? RED : GREEN) : (is_red_col? GREEN : BLUE);
+}
+
+inline const char* name(PATTERN value)
+{
+	switch (value) {
+		case RGGB:
+			return "RGGB";
+		case BGGR:
+			return "BGGR";
+		case GBRG:
+			return "GBRG";
+		case GRBG:
+		default:
+			return "GRBG";
+	}
+}
+
+}
+
+#endif // CFA_H
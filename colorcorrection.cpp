@@ -0,0 +1,105 @@
+#include "colorcorrection.h"
+
+#include <QStringList>
+#include <QRegExp>
+#include <QVector>
+
+#include <math.h>
+
+ColorCorrection::ColorCorrection()
+{
+	for(int c = 0; c < 3; ++c){
+		black[c] = 0;
+		gains[c] = 1;
+	}
+	for(int k = 0; k < 9; ++k){
+		matrix[k] = (k % 4) == 0? 1 : 0;
+	}
+}
+
+bool ColorCorrection::is_identity() const
+{
+	return *this == ColorCorrection();
+}
+
+pixel::Correction ColorCorrection::fixed(int lshift) const
+{
+	pixel::Correction res;
+	const double one = 1 << pixel::Correction::BITS;
+	/// sum of modules of row is not more than 15: sums of 16-bit values stay in 32 bit with bias of vector kernels
+	const double limit = 15 << pixel::Correction::BITS;
+
+	for(int c = 0; c < 3; ++c){
+		const double value = qMax(0., black[c]) * (1 << lshift);
+		res.black[c] = (int)qMin< double >(pixel::Correction::MAX, floor(value + 0.5));
+
+		double row[3];
+		double sum = 0;
+		for(int k = 0; k < 3; ++k){
+			row[k] = matrix[3 * c + k] * gains[k] * one;
+			sum += fabs(row[k]);
+		}
+		const double scale = sum > limit? limit / sum : 1;
+		for(int k = 0; k < 3; ++k){
+			res.m[3 * c + k] = (int)floor(row[k] * scale + 0.5);
+		}
+		/// rounding must not exceed the limit
+		int total = 0;
+		for(int k = 0; k < 3; ++k){
+			total += qAbs(res.m[3 * c + k]);
+		}
+		for(int k = 0; total > limit && k < 3; ++k){
+			if(res.m[3 * c + k]){
+				res.m[3 * c + k] += res.m[3 * c + k] > 0? -1 : 1;
+				--total;
+			}
+		}
+	}
+	return res;
+}
+
+bool ColorCorrection::parse(const QString &text, double *values, int count)
+{
+	const QStringList list = text.split(QRegExp("[,;\\s]+"), QString::SkipEmptyParts);
+	if(list.size() != count && !(list.size() == 1 && count == 3))
+		return false;
+
+	QVector< double > res(list.size());
+	for(int k = 0; k < list.size(); ++k){
+		bool ok = false;
+		res[k] = list[k].toDouble(&ok);
+		if(!ok)
+			return false;
+	}
+	for(int k = 0; k < count; ++k){
+		values[k] = res[qMin(k, res.size() - 1)];
+	}
+	return true;
+}
+
+QString ColorCorrection::text(const double *values, int count)
+{
+	QStringList res;
+	for(int k = 0; k < count; ++k){
+		res << QString::number(values[k]);
+	}
+	return res.join(",");
+}
+
+bool ColorCorrection::operator==(const ColorCorrection &other) const
+{
+	for(int c = 0; c < 3; ++c){
+		if(black[c] != other.black[c] || gains[c] != other.gains[c])
+			return false;
+	}
+	for(int k = 0; k < 9; ++k){
+		if(matrix[k] != other.matrix[k])
+			return false;
+	}
+	return true;
+}
+
+bool ColorCorrection::operator!=(const ColorCorrection &other) const
+{
+	return !(*this == other);
+}
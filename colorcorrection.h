@@ -0,0 +1,49 @@
+#ifndef COLORCORRECTION_H
+#define COLORCORRECTION_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "pixel_out.h"
+
+///////////////////////////////////////////////
+/// \brief The ColorCorrection struct
+/// black level, white balance and matrix of camera rgb to sRGB:
+/// out = matrix * (gains * (in - black)). kernels of demoscaling apply it to every pixel
+/// before output in fixed point (pixel::Correction), so it costs no pass over frame.
+/// default is identity (kernels are not changed)
+///
+
+struct ColorCorrection{
+	double black[3];		/// red, green, blue in source values (before left shift)
+	double gains[3];		/// white balance of red, green, blue
+	double matrix[9];		/// by rows: output red, green, blue from camera red, green, blue
+
+	ColorCorrection();
+
+	bool is_identity() const;
+	/**
+	 * @brief fixed
+	 * coefficients for kernels: black is shifted by lshift, gains are joined to columns of matrix.
+	 * row with sum of modules over 15 is scaled down (limit of 32-bit sums)
+	 * @param lshift - left shift of source values
+	 * @return
+	 */
+	pixel::Correction fixed(int lshift) const;
+
+	/**
+	 * @brief parse
+	 * list of count numbers separated by comma or spaces; one number for count 3 is copied to all
+	 * @param text
+	 * @param values - not changed if text is wrong
+	 * @param count
+	 * @return
+	 */
+	static bool parse(const QString& text, double* values, int count);
+	static QString text(const double* values, int count);
+
+	bool operator== (const ColorCorrection& other) const;
+	bool operator!= (const ColorCorrection& other) const;
+};
+
+#endif // COLORCORRECTION_H
@@ -0,0 +1,639 @@
+#include "demosaic_hq.h"
+#include "tonecurve.h"
+#include "simd_target.h"
+#include "pixel_out.h"
+
+#include <vector>
+#include <stdlib.h>
+#include <limits.h>
+
+/////////////////////////////////
+/// \brief max of 16-bit value
+#define MAX_USHORT				(65535)
+/// \brief rows of tile of AHD (buffers of tile are reused)
+#define AHD_TILE				(64)
+/// \brief rows around tile of AHD
+#define AHD_HALO				(3)
+
+namespace hq{
+
+const char *method_name(METHOD value)
+{
+	switch (value) {
+		case VNG:
+			return "vng";
+		case AHD:
+			return "ahd";
+		case MALVAR:
+		default:
+			return "malvar";
+	}
+}
+
+bool supported(int width, int height)
+{
+	return width >= 8 && height >= 8;
+}
+
+/////////////////////////////////
+/// \brief mirror
+/// coordinate reflected at border (parity is kept), for buffers of AHD without halo
+inline int mirror(int i, int n)
+{
+	return i < 0? -i : (i >= n? 2 * (n - 1) - i : i);
+}
+
+inline int clamp16(int v)
+{
+	return v < 0? 0 : (v > MAX_USHORT? MAX_USHORT : v);
+}
+
+/////////////////////////////////
+/// \brief The Frame struct
+/// bayer frame with left shift and mirrored halo of cfa::HALO pixels
+
+struct Frame{
+	const ushort* bayer;
+	int stride;
+	int width;
+	int height;
+	int lshift;
+
+	/// pixel of frame or of halo
+	inline int at(int i, int j) const{
+		return static_cast< ushort >(bayer[(qint64)i * stride + j] << lshift);
+	}
+	inline const ushort* row(int i) const{
+		return bayer + (qint64)i * stride;
+	}
+};
+
+/////////////////////////////////
+/// \brief The Sampler struct
+/// neighbours of pixel (i, j), near border they are in halo
+
+struct Sampler{
+	Sampler(const Frame& f, int i, int j)
+		: f(f), i(i), j(j){}
+
+	inline int operator()(int di, int dj) const{
+		return f.at(i + di, j + dj);
+	}
+
+	const Frame& f;
+	int i;
+	int j;
+};
+
+/////////////////////////////////
+/// Malvar, He, Cutler: bilinear with correction by laplacian of own color.
+/// filters are scaled by 16 (halves of original coefficients), result is rounded
+
+enum{
+	F_C,		/// own value
+	F_G,		/// green on red or blue
+	F_HOR,		/// red or blue on green, neighbours of color in row
+	F_VER,		/// same, neighbours in column
+	F_DIAG		/// red on blue and blue on red
+};
+
+/// filter for channel CH of pixel with parity (Y, X)
+template< int P, int Y, int X, int CH >
+struct MalvarFilter{
+	typedef cfa::Layout< P > L;
+	enum{
+		COLOR = static_cast< int >(L::template Color< Y, X >::value),
+		ROW = ((Y ^ L::RED_ROW) & 1)? static_cast< int >(cfa::BLUE) : static_cast< int >(cfa::RED),
+		value = COLOR == CH? F_C
+				: CH == cfa::GREEN? F_G
+				: COLOR == cfa::GREEN? (CH == ROW? F_HOR : F_VER)
+				: F_DIAG
+	};
+};
+
+struct Malvar{
+	template< int P, int Y, int X, typename S, typename O >
+	static inline typename O::Pixel pixel(const S& s, const O& o)
+	{
+		const int c = s(0, 0);
+		const int h1 = s(0, -1) + s(0, 1);
+		const int v1 = s(-1, 0) + s(1, 0);
+		const int h2 = s(0, -2) + s(0, 2);
+		const int v2 = s(-2, 0) + s(2, 0);
+		const int d = s(-1, -1) + s(-1, 1) + s(1, -1) + s(1, 1);
+
+		int f[5];
+		f[F_C]		= c;
+		f[F_G]		= clamp16((8 * c + 4 * (h1 + v1) - 2 * (h2 + v2) + 8) >> 4);
+		f[F_HOR]	= clamp16((10 * c + 8 * h1 - 2 * h2 - 2 * d + v2 + 8) >> 4);
+		f[F_VER]	= clamp16((10 * c + 8 * v1 - 2 * v2 - 2 * d + h2 + 8) >> 4);
+		f[F_DIAG]	= clamp16((12 * c + 4 * d - 3 * (h2 + v2) + 8) >> 4);
+
+		return o(f[MalvarFilter< P, Y, X, cfa::RED >::value],
+				 f[MalvarFilter< P, Y, X, cfa::GREEN >::value],
+				 f[MalvarFilter< P, Y, X, cfa::BLUE >::value]);
+	}
+
+	template< int P, int Y, typename O >
+	static int vector_row(const Frame& f, const O& o, int i, typename O::Pixel* out, int x0, int x1, simd::LEVEL level);
+};
+
+/////////////////////////////////
+/// Chang, Cheung, Pang: variable number of gradients.
+/// gradients in 8 directions, colors are averaged by directions with gradient not more than threshold
+
+struct Vng{
+	template< int P, int Y, int X, typename S, typename O >
+	static inline typename O::Pixel pixel(const S& s, const O& o)
+	{
+		typedef cfa::Layout< P > L;
+		static const int dirs[8][2] = {
+			{-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}
+		};
+		const int own = L::template Color< Y, X >::value;
+
+		/// neighbourhood 5x5 is read once
+		int v[5][5];
+		for(int di = 0; di < 5; ++di){
+			for(int dj = 0; dj < 5; ++dj){
+				v[di][dj] = s(di - 2, dj - 2);
+			}
+		}
+		auto at = [&v](int di, int dj){ return v[di + 2][dj + 2]; };
+		const int center = at(0, 0);
+
+		int grad[8];
+		int gmin = INT_MAX, gmax = 0;
+		for(int k = 0; k < 8; ++k){
+			const int dy = dirs[k][0], dx = dirs[k][1];
+			int g = abs(at(dy, dx) - at(-dy, -dx)) + abs(at(2 * dy, 2 * dx) - center);
+			if(dy && dx){
+				g += (abs(at(dy, 0) - at(dy, 2 * dx)) + abs(at(0, dx) - at(2 * dy, dx))) >> 1;
+			}else{
+				/// perpendicular of direction
+				const int py = dx, px = dy;
+				g += (abs(at(dy + py, dx + px) - at(-dy + py, -dx + px))
+					  + abs(at(dy - py, dx - px) - at(-dy - py, -dx - px))) >> 1;
+			}
+			grad[k] = g;
+			gmin = qMin(gmin, g);
+			gmax = qMax(gmax, g);
+		}
+		/// 1.5 * min + 0.5 * (max - min)
+		const int thr = gmin + (gmin >> 1) + ((gmax - gmin) >> 1);
+
+		int sum[3] = {0, 0, 0};
+		int n = 0;
+		for(int k = 0; k < 8; ++k){
+			if(grad[k] > thr)
+				continue;
+			const int dy = dirs[k][0], dx = dirs[k][1];
+			/// pixels of direction: center and 2 steps (own color), 1 step and sides (other colors)
+			int pos[7][2] = {
+				{0, 0}, {2 * dy, 2 * dx}, {dy, dx}
+			};
+			int np = 3;
+			if(dy && dx){
+				pos[np][0] = dy;	pos[np++][1] = 0;
+				pos[np][0] = 0;		pos[np++][1] = dx;
+			}else{
+				const int py = dx, px = dy;
+				pos[np][0] = dy + py;	pos[np++][1] = dx + px;
+				pos[np][0] = dy - py;	pos[np++][1] = dx - px;
+				pos[np][0] = py;		pos[np++][1] = px;
+				pos[np][0] = -py;		pos[np++][1] = -px;
+			}
+			int cs[3] = {0, 0, 0}, cn[3] = {0, 0, 0};
+			for(int p = 0; p < np; ++p){
+				int c = L::color(Y + pos[p][0], X + pos[p][1]);
+				cs[c] += at(pos[p][0], pos[p][1]);
+				cn[c]++;
+			}
+			for(int c = 0; c < 3; ++c){
+				sum[c] += cs[c] / qMax(cn[c], 1);
+			}
+			n++;
+		}
+
+		int rgb[3];
+		for(int c = 0; c < 3; ++c){
+			rgb[c] = c == own? center : clamp16(center + (sum[c] - sum[own]) / n);
+		}
+		return o(rgb[cfa::RED], rgb[cfa::GREEN], rgb[cfa::BLUE]);
+	}
+
+	template< int P, int Y, typename O >
+	static int vector_row(const Frame&, const O&, int, typename O::Pixel*, int x0, int, simd::LEVEL)
+	{
+		return x0;
+	}
+};
+
+#if defined(SIMD_X86)
+
+/////////////////////////////////
+/// sse2 version of Malvar: 8 pixels by iteration in two halves of 4 lanes of 32 bit.
+/// x0 is even, so lane 0 is always even column
+
+SIMD_TARGET_SSE2
+static inline __m128i load_epu16(const ushort* d, __m128i lsh)
+{
+	return _mm_sll_epi16(_mm_loadu_si128(reinterpret_cast< const __m128i* >(d)), lsh);
+}
+
+SIMD_TARGET_SSE2
+static inline __m128i half_epi32(__m128i v, int k)
+{
+	return k? _mm_unpackhi_epi16(v, _mm_setzero_si128()) : _mm_unpacklo_epi16(v, _mm_setzero_si128());
+}
+
+SIMD_TARGET_SSE2
+static inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// (v + 8) >> 4 with clamp to [0, 65535]
+SIMD_TARGET_SSE2
+static inline __m128i round_clamp16(__m128i v)
+{
+	const __m128i max16 = _mm_set1_epi32(MAX_USHORT);
+	v = _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(8)), 4);
+	v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+	return select_si128(_mm_cmpgt_epi32(v, max16), max16, v);
+}
+
+template< int P, int Y, typename O >
+SIMD_TARGET_SSE2
+static int malvar_row_sse2(const Frame& f, const O& o, int i, typename O::Pixel* out, int x0, int x1)
+{
+	const __m128i lsh = _mm_cvtsi32_si128(f.lshift);
+	const __m128i even32 = _mm_set_epi32(0, -1, 0, -1);
+	const ushort* bm2 = f.row(i - 2);
+	const ushort* bm1 = f.row(i - 1);
+	const ushort* b0 = f.row(i);
+	const ushort* bp1 = f.row(i + 1);
+	const ushort* bp2 = f.row(i + 2);
+
+	int j = x0;
+	for(; j + 8 <= x1; j += 8){
+		__m128i C = load_epu16(b0 + j, lsh);
+		__m128i L1 = load_epu16(b0 + j - 1, lsh);
+		__m128i R1 = load_epu16(b0 + j + 1, lsh);
+		__m128i L2 = load_epu16(b0 + j - 2, lsh);
+		__m128i R2 = load_epu16(b0 + j + 2, lsh);
+		__m128i U1 = load_epu16(bm1 + j, lsh);
+		__m128i D1 = load_epu16(bp1 + j, lsh);
+		__m128i U2 = load_epu16(bm2 + j, lsh);
+		__m128i D2 = load_epu16(bp2 + j, lsh);
+		__m128i UL = load_epu16(bm1 + j - 1, lsh);
+		__m128i UR = load_epu16(bm1 + j + 1, lsh);
+		__m128i DL = load_epu16(bp1 + j - 1, lsh);
+		__m128i DR = load_epu16(bp1 + j + 1, lsh);
+
+		for(int k = 0; k < 2; ++k){
+			__m128i c = half_epi32(C, k);
+			__m128i h1 = _mm_add_epi32(half_epi32(L1, k), half_epi32(R1, k));
+			__m128i v1 = _mm_add_epi32(half_epi32(U1, k), half_epi32(D1, k));
+			__m128i h2 = _mm_add_epi32(half_epi32(L2, k), half_epi32(R2, k));
+			__m128i v2 = _mm_add_epi32(half_epi32(U2, k), half_epi32(D2, k));
+			__m128i d = _mm_add_epi32(_mm_add_epi32(half_epi32(UL, k), half_epi32(UR, k)),
+									  _mm_add_epi32(half_epi32(DL, k), half_epi32(DR, k)));
+			__m128i c8 = _mm_slli_epi32(c, 3);
+			__m128i c10 = _mm_add_epi32(c8, _mm_slli_epi32(c, 1));
+			__m128i d2 = _mm_slli_epi32(d, 1);
+			__m128i hv2 = _mm_add_epi32(h2, v2);
+
+			__m128i fl[5];
+			fl[F_C] = c;
+			/// 8c + 4(h1 + v1) - 2(h2 + v2)
+			fl[F_G] = round_clamp16(_mm_sub_epi32(_mm_add_epi32(c8, _mm_slli_epi32(_mm_add_epi32(h1, v1), 2)),
+												  _mm_slli_epi32(hv2, 1)));
+			/// 10c + 8h1 - 2h2 - 2d + v2
+			fl[F_HOR] = round_clamp16(_mm_add_epi32(_mm_sub_epi32(_mm_add_epi32(c10, _mm_slli_epi32(h1, 3)),
+																  _mm_add_epi32(_mm_slli_epi32(h2, 1), d2)), v2));
+			/// 10c + 8v1 - 2v2 - 2d + h2
+			fl[F_VER] = round_clamp16(_mm_add_epi32(_mm_sub_epi32(_mm_add_epi32(c10, _mm_slli_epi32(v1, 3)),
+																  _mm_add_epi32(_mm_slli_epi32(v2, 1), d2)), h2));
+			/// 12c + 4d - 3(h2 + v2)
+			fl[F_DIAG] = round_clamp16(_mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(c8, _mm_slli_epi32(c, 2)), _mm_slli_epi32(d, 2)),
+													 _mm_add_epi32(_mm_slli_epi32(hv2, 1), hv2)));
+
+			__m128i red = select_si128(even32, fl[MalvarFilter< P, Y, 0, cfa::RED >::value],
+													fl[MalvarFilter< P, Y, 1, cfa::RED >::value]);
+			__m128i green = select_si128(even32, fl[MalvarFilter< P, Y, 0, cfa::GREEN >::value],
+													fl[MalvarFilter< P, Y, 1, cfa::GREEN >::value]);
+			__m128i blue = select_si128(even32, fl[MalvarFilter< P, Y, 0, cfa::BLUE >::value],
+													fl[MalvarFilter< P, Y, 1, cfa::BLUE >::value]);
+
+			int vr[4], vg[4], vb[4];
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vr), red);
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vg), green);
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vb), blue);
+			for(int l = 0; l < 4; ++l){
+				out[j + 4 * k + l] = o(vr[l], vg[l], vb[l]);
+			}
+		}
+	}
+	return j;
+}
+
+#endif
+
+template< int P, int Y, typename O >
+int Malvar::vector_row(const Frame &f, const O &o, int i, typename O::Pixel *out, int x0, int x1, simd::LEVEL level)
+{
+#if defined(SIMD_X86)
+	if(level >= simd::SSE2)
+		return malvar_row_sse2< P, Y >(f, o, i, out, x0, x1);
+#else
+	Q_UNUSED(f);
+	Q_UNUSED(o);
+	Q_UNUSED(i);
+	Q_UNUSED(out);
+	Q_UNUSED(x1);
+	Q_UNUSED(level);
+#endif
+	return x0;
+}
+
+/////////////////////////////////
+/// \brief span
+/// pixels [x0, x1) of row i by pairs of columns, parity of both is known at compile time
+
+template< typename K, int P, int Y, typename O >
+static void span(const Frame& f, const O& o, int i, typename O::Pixel* out, int x0, int x1)
+{
+	int j = x0;
+	if((j & 1) && j < x1){
+		out[j] = K::template pixel< P, Y, 1 >(Sampler(f, i, j), o);
+		++j;
+	}
+	for(; j + 1 < x1; j += 2){
+		out[j]		= K::template pixel< P, Y, 0 >(Sampler(f, i, j), o);
+		out[j + 1]	= K::template pixel< P, Y, 1 >(Sampler(f, i, j + 1), o);
+	}
+	if(j < x1)
+		out[j] = K::template pixel< P, Y, 0 >(Sampler(f, i, j), o);
+}
+
+/////////////////////////////////
+/// \brief pixel_row
+/// row of kernel with neighbourhood 5x5, the whole row by the same loop (border is in halo)
+
+template< typename K, int P, int Y, typename O >
+static void pixel_row(const Frame& f, const O& o, int i, typename O::Pixel* out, simd::LEVEL level)
+{
+	int j = K::template vector_row< P, Y >(f, o, i, out, 0, f.width, level);
+	span< K, P, Y >(f, o, i, out, j, f.width);
+}
+
+template< typename K, int P, typename O >
+static void pixel_rows(const Frame& f, const O& o, uchar* image, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	for(int i = y0; i < y1; ++i){
+		typename O::Pixel* out = reinterpret_cast< typename O::Pixel* >(image + (qint64)i * bpl);
+		if(i & 1)
+			pixel_row< K, P, 1 >(f, o, i, out, level);
+		else
+			pixel_row< K, P, 0 >(f, o, i, out, level);
+	}
+}
+
+/////////////////////////////////
+/// Hirakawa, Parks: adaptive homogeneity-directed.
+/// frame is interpolated by rows and by columns, for every pixel the direction
+/// with more homogeneous neighbourhood (in luminance and chrominance) is taken.
+/// band is processed by tiles of AHD_TILE rows with AHD_HALO rows around
+
+struct AhdTile{
+	AhdTile(int width)
+		: width(width)
+	{
+		int size = (AHD_TILE + 2 * AHD_HALO) * width;
+		for(int d = 0; d < 2; ++d){
+			green[d].resize(size);
+			rgb[d].resize(size * 3);
+			lab[d].resize(size * 3);
+			homo[d].resize(size);
+		}
+	}
+
+	int width;
+	/// 0 - by rows, 1 - by columns
+	std::vector< int > green[2];
+	std::vector< int > rgb[2];
+	std::vector< int > lab[2];
+	std::vector< uchar > homo[2];
+};
+
+inline int ulim(int x, int a, int b)
+{
+	return a < b? qBound(a, x, b) : qBound(b, x, a);
+}
+
+template< int P, typename O >
+static void ahd_tile(const Frame& f, const O& o, uchar* image, int bpl, int y0, int y1, AhdTile& t)
+{
+	typedef cfa::Layout< P > L;
+	static const int nb[4][2] = { {0, -1}, {0, 1}, {-1, 0}, {1, 0} };
+	const int W = f.width;
+	const int r0 = y0 - AHD_HALO;
+	const int R = y1 - y0 + 2 * AHD_HALO;
+
+	/// green by rows and by columns (Hamilton-Adams, limited by neighbours)
+	for(int k = 0; k < R; ++k){
+		const int i = r0 + k;
+		int* gh = &t.green[0][k * W];
+		int* gv = &t.green[1][k * W];
+		for(int j = 0; j < W; ++j){
+			const int c = f.at(i, j);
+			if(L::color(i, j) == cfa::GREEN){
+				gh[j] = gv[j] = c;
+				continue;
+			}
+			const int l = f.at(i, j - 1), r = f.at(i, j + 1);
+			const int u = f.at(i - 1, j), d = f.at(i + 1, j);
+			gh[j] = ulim(((l + c + r) * 2 - f.at(i, j - 2) - f.at(i, j + 2)) >> 2, l, r);
+			gv[j] = ulim(((u + c + d) * 2 - f.at(i - 2, j) - f.at(i + 2, j)) >> 2, u, d);
+		}
+	}
+
+	/// red and blue by differences with green of the same direction, then luminance and chrominance
+	for(int dir = 0; dir < 2; ++dir){
+		const int* g = &t.green[dir][0];
+		for(int k = 1; k < R - 1; ++k){
+			const int i = r0 + k;
+			for(int j = 0; j < W; ++j){
+				const int jl = mirror(j - 1, W), jr = mirror(j + 1, W);
+				const int gc = g[k * W + j];
+				const int color = L::color(i, j);
+				int* px = &t.rgb[dir][(k * W + j) * 3];
+
+				px[cfa::GREEN] = gc;
+				if(color == cfa::GREEN){
+					int hor = clamp16(gc + ((f.at(i, j - 1) - g[k * W + jl]
+											 + f.at(i, j + 1) - g[k * W + jr]) >> 1));
+					int ver = clamp16(gc + ((f.at(i - 1, j) - g[(k - 1) * W + j]
+											 + f.at(i + 1, j) - g[(k + 1) * W + j]) >> 1));
+					const bool red_row = L::color(i, j + 1) == cfa::RED;
+					px[cfa::RED] = red_row? hor : ver;
+					px[cfa::BLUE] = red_row? ver : hor;
+				}else{
+					int diag = clamp16(gc + ((f.at(i - 1, j - 1) - g[(k - 1) * W + jl]
+											  + f.at(i - 1, j + 1) - g[(k - 1) * W + jr]
+											  + f.at(i + 1, j - 1) - g[(k + 1) * W + jl]
+											  + f.at(i + 1, j + 1) - g[(k + 1) * W + jr]) >> 2));
+					px[color] = f.at(i, j);
+					px[color == cfa::RED? cfa::BLUE : cfa::RED] = diag;
+				}
+
+				int* lab = &t.lab[dir][(k * W + j) * 3];
+				lab[0] = px[cfa::RED] + 2 * px[cfa::GREEN] + px[cfa::BLUE];
+				lab[1] = px[cfa::RED] - px[cfa::GREEN];
+				lab[2] = px[cfa::BLUE] - px[cfa::GREEN];
+			}
+		}
+	}
+
+	/// homogeneity: neighbours closer than epsilon, epsilon is taken by the direction of interpolation
+	for(int k = 2; k < R - 2; ++k){
+		for(int j = 0; j < W; ++j){
+			int ldiff[2][4];
+			qint64 abdiff[2][4];
+			for(int dir = 0; dir < 2; ++dir){
+				const int* c = &t.lab[dir][(k * W + j) * 3];
+				for(int n = 0; n < 4; ++n){
+					const int* o = &t.lab[dir][((k + nb[n][0]) * W + mirror(j + nb[n][1], W)) * 3];
+					qint64 da = c[1] - o[1], db = c[2] - o[2];
+					ldiff[dir][n] = abs(c[0] - o[0]);
+					abdiff[dir][n] = da * da + db * db;
+				}
+			}
+			const int leps = qMin(qMax(ldiff[0][0], ldiff[0][1]), qMax(ldiff[1][2], ldiff[1][3]));
+			const qint64 abeps = qMin(qMax(abdiff[0][0], abdiff[0][1]), qMax(abdiff[1][2], abdiff[1][3]));
+			for(int dir = 0; dir < 2; ++dir){
+				int cnt = 0;
+				for(int n = 0; n < 4; ++n){
+					cnt += ldiff[dir][n] <= leps && abdiff[dir][n] <= abeps;
+				}
+				t.homo[dir][k * W + j] = cnt;
+			}
+		}
+	}
+
+	/// direction with more homogeneous 3x3 neighbourhood, average if equal
+	for(int i = y0; i < y1; ++i){
+		const int k = i - r0;
+		typename O::Pixel* out = reinterpret_cast< typename O::Pixel* >(image + (qint64)i * bpl);
+		for(int j = 0; j < W; ++j){
+			int hm[2] = {0, 0};
+			for(int dir = 0; dir < 2; ++dir){
+				for(int di = -1; di <= 1; ++di){
+					const uchar* h = &t.homo[dir][(k + di) * W];
+					hm[dir] += h[mirror(j - 1, W)] + h[j] + h[mirror(j + 1, W)];
+				}
+			}
+			const int* ph = &t.rgb[0][(k * W + j) * 3];
+			const int* pv = &t.rgb[1][(k * W + j) * 3];
+			if(hm[0] > hm[1]){
+				out[j] = o(ph[0], ph[1], ph[2]);
+			}else if(hm[0] < hm[1]){
+				out[j] = o(pv[0], pv[1], pv[2]);
+			}else{
+				out[j] = o((ph[0] + pv[0]) >> 1, (ph[1] + pv[1]) >> 1, (ph[2] + pv[2]) >> 1);
+			}
+		}
+	}
+}
+
+template< int P, typename O >
+static void ahd(const Frame& f, const O& o, uchar* image, int bpl, int y0, int y1)
+{
+	AhdTile tile(f.width);
+	for(int t0 = y0; t0 < y1; t0 += AHD_TILE){
+		ahd_tile< P >(f, o, image, bpl, t0, qMin(t0 + AHD_TILE, y1), tile);
+	}
+}
+
+/////////////////////////////////
+
+template< int P, typename O >
+static void demosaic_cfa(METHOD method, const Frame& f, const O& o, uchar* image, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	switch (method) {
+		case VNG:
+			pixel_rows< Vng, P >(f, o, image, bpl, level, y0, y1);
+			break;
+		case AHD:
+			ahd< P >(f, o, image, bpl, y0, y1);
+			break;
+		case MALVAR:
+		default:
+			pixel_rows< Malvar, P >(f, o, image, bpl, level, y0, y1);
+			break;
+	}
+}
+
+template< typename O >
+static void demosaic_frame(METHOD method, const Frame& f, const O& o, cfa::PATTERN pattern,
+						   uchar* image, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	y0 = qMax(y0, 0);
+	y1 = qMin(y1, f.height);
+
+	switch (pattern) {
+		case cfa::RGGB:
+			demosaic_cfa< cfa::RGGB >(method, f, o, image, bpl, level, y0, y1);
+			break;
+		case cfa::BGGR:
+			demosaic_cfa< cfa::BGGR >(method, f, o, image, bpl, level, y0, y1);
+			break;
+		case cfa::GBRG:
+			demosaic_cfa< cfa::GBRG >(method, f, o, image, bpl, level, y0, y1);
+			break;
+		case cfa::GRBG:
+		default:
+			demosaic_cfa< cfa::GRBG >(method, f, o, image, bpl, level, y0, y1);
+			break;
+	}
+}
+
+/// correction is made by policy of output: every kernel gives all pixels to it
+template< typename O >
+static void demosaic_output(METHOD method, const Frame& f, const pixel::Correction* correction, const O& o,
+							cfa::PATTERN pattern, uchar* image, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	if(correction){
+		const pixel::Corrected< O > co = { o, *correction };
+		demosaic_frame(method, f, co, pattern, image, bpl, level, y0, y1);
+	}else{
+		demosaic_frame(method, f, o, pattern, image, bpl, level, y0, y1);
+	}
+}
+
+void demosaic(METHOD method, const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction *correction,
+			  const ToneCurve &tone, cfa::PATTERN pattern, uchar *image, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	if(!supported(width, height))
+		return;
+
+	const Frame f = { bayer, stride, width, height, lshift };
+	const pixel::Tone8 o = { tone.lut() };
+
+	demosaic_output(method, f, correction, o, pattern, image, bpl, level, y0, y1);
+}
+
+void demosaic_rgb16(METHOD method, const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction *correction,
+					cfa::PATTERN pattern, uchar *rgb, int bpl, simd::LEVEL level, int y0, int y1)
+{
+	if(!supported(width, height))
+		return;
+
+	const Frame f = { bayer, stride, width, height, lshift };
+	const pixel::Rgb16 o = pixel::Rgb16();
+
+	demosaic_output(method, f, correction, o, pattern, rgb, bpl, level, y0, y1);
+}
+
+}
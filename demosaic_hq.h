@@ -0,0 +1,62 @@
+#ifndef DEMOSAIC_HQ_H
+#define DEMOSAIC_HQ_H
+
+#include <QtGlobal>
+
+#include "cfa.h"
+#include "demosaic_simd.h"
+
+class ToneCurve;
+
+namespace hq{
+
+enum METHOD{
+	MALVAR,		/// gradient-corrected bilinear (Malvar, He, Cutler)
+	VNG,		/// variable number of gradients
+	AHD			/// adaptive homogeneity-directed
+};
+
+const char* method_name(METHOD value);
+
+/**
+ * @brief supported
+ * frame geometry handled by hq::demosaic (not less than 8x8, odd sizes are allowed)
+ * @param width
+ * @param height
+ * @return
+ */
+bool supported(int width, int height);
+/**
+ * @brief demosaic
+ * high quality demoscaling. all pixels of rows [y0, y1) are written (border is mirrored),
+ * rows are independent, so the frame may be split to bands between threads.
+ * MALVAR is vectorized (sse2), VNG is made by pixel, AHD by tiles of rows with halo
+ * @param method
+ * @param bayer - pixel (0, 0) of bayer frame with mirrored halo of cfa::HALO pixels (see Mat::fill_halo)
+ * @param stride - elements from row to row
+ * @param width
+ * @param height
+ * @param lshift - left shift of source value (result is cut to 16 bit)
+ * @param correction - black level, white balance and color matrix before output (see simd::linear), 0 - none
+ * @param tone - 16 to 8 bit conversion (table must be updated)
+ * @param pattern - layout of color filter
+ * @param image - ARGB32 output
+ * @param bpl - bytes per line of output
+ * @param level - instruction set
+ * @param y0 - first row of output
+ * @param y1 - row after last
+ */
+void demosaic(METHOD method, const ushort* bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+			  const ToneCurve& tone, cfa::PATTERN pattern, uchar* image, int bpl, simd::LEVEL level, int y0, int y1);
+/**
+ * @brief demosaic_rgb16
+ * the same without tone mapping: 16 bit by channel (layout of QRgba64, see pixel::Rgb16)
+ * @param rgb - output of 8 bytes by pixel
+ * @param bpl - bytes per line of output
+ */
+void demosaic_rgb16(METHOD method, const ushort* bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+					cfa::PATTERN pattern, uchar* rgb, int bpl, simd::LEVEL level, int y0, int y1);
+
+}
+
+#endif // DEMOSAIC_HQ_H
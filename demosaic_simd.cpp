@@ -0,0 +1,789 @@
+#include "demosaic_simd.h"
+#include "tonecurve.h"
+#include "simd_target.h"
+#include "pixel_out.h"
+
+/////////////////////////////////
+/// \brief for set alpha in uint
+#define MASK_ALPHAMAX_UCHAR		(0xff000000)
+/// \brief for crpp color value
+#define MAX_UCHAR				(255)
+
+namespace simd{
+
+/////////////////////////////////
+
+static LEVEL detect_level()
+{
+#if defined(SIMD_X86)
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return SSE2;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int count = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	if(avx && count >= 7){
+		__cpuidex(info, 7, 0);
+		if(info[1] & (1 << 5))
+			return AVX2;
+	}
+	if(sse2)
+		return SSE2;
+#endif
+#endif
+	return SCALAR;
+}
+
+LEVEL level()
+{
+	static const LEVEL value = detect_level();
+	return value;
+}
+
+const char *level_name(LEVEL value)
+{
+	switch (value) {
+		case SSE2:
+			return "sse2";
+		case AVX2:
+			return "avx2";
+		case SCALAR:
+		default:
+			return "scalar";
+	}
+}
+
+bool linear_supported(int width, int height)
+{
+	return width >= 8 && height >= 8;
+}
+
+/////////////////////////////////
+
+/// rows of bayer around row "row" of frame (rows out of frame are rows of halo)
+struct LinearRow{
+	const ushort *bm2;		/// row - 2
+	const ushort *bm1;		/// row - 1
+	const ushort *b0;		/// row
+	const ushort *bp1;		/// row + 1
+	int row;
+	int lshift;
+	int shift;				/// right shift of vector version, -1 - arbitrary curve by table (or 16-bit output)
+	const pixel::Correction* cc;	/// black level, white balance and matrix, 0 - none
+};
+
+/////////////////////////////////
+/// \brief sample
+/// value of bayer after left shift (cut to 16 bit as in stored matrix)
+inline int sample(const ushort* d, int j, int lshift)
+{
+	return static_cast< ushort >(d[j] << lshift);
+}
+
+/////////////////////////////////
+/// kernels are written for GRBG; pattern P is handled as GRBG with phase (DY, DX),
+/// all checks of parity are made by row or by template argument, not by pixel.
+/// frame has mirrored halo, so border is computed by the same formulas as inside
+
+/////////////////////////////////
+/// \brief own_value
+/// own color of row d (red for rows of red, blue for rows of blue) in column j:
+/// as is or mean of neighbours in row
+inline int own_value(const ushort* d, int j, bool green, int lshift)
+{
+	return green? (sample(d, j - 1, lshift) + sample(d, j + 1, lshift)) >> 1 : sample(d, j, lshift);
+}
+
+/////////////////////////////////
+/// \brief green_value
+/// green of the green pass: 5 points with diagonals on green pixels, cross otherwise
+template< int P >
+inline int green_value(const LinearRow& a, int j)
+{
+	typedef cfa::Layout< P > L;
+	const int ls = a.lshift;
+	const int ii = a.row + L::DY;
+	if(((ii + j + L::DX) & 1) == 0){
+		int c = (ii & 1)? sample(a.b0, j, ls) : sample(a.bm2, j, ls);
+		return (sample(a.bm1, j - 1, ls) + sample(a.bm1, j + 1, ls)
+				+ sample(a.bp1, j - 1, ls) + sample(a.bp1, j + 1, ls) + c) / 5;
+	}
+	return (sample(a.bm1, j, ls) + sample(a.b0, j - 1, ls) + sample(a.b0, j + 1, ls) + sample(a.bp1, j, ls)) >> 2;
+}
+
+template< int P, typename O >
+inline typename O::Pixel linear_pixel(const LinearRow& a, const O& o, int j)
+{
+	typedef cfa::Layout< P > L;
+	const int r = a.row;
+	const bool blue_row = ((r + L::DY) & 1) != 0;
+	/// green pixel: own color of row is between neighbours, rows above and below have it in place
+	const bool green = ((r + L::DY + j + L::DX) & 1) == 0;
+	int own = own_value(a.b0, j, green, a.lshift);
+	int other = (own_value(a.bm1, j, !green, a.lshift) + own_value(a.bp1, j, !green, a.lshift)) >> 1;
+	int g = green_value< P >(a, j);
+	int red = blue_row? other : own;
+	int blue = blue_row? own : other;
+	if(a.cc)
+		(*a.cc)(red, g, blue);
+	return o(red, g, blue);
+}
+
+template< int P, typename O >
+static void linear_row_scalar(const LinearRow& a, const O& o, typename O::Pixel* out, int x0, int x1)
+{
+	for(int j = x0; j < x1; ++j){
+		out[j] = linear_pixel< P >(a, o, j);
+	}
+}
+
+#if defined(SIMD_X86)
+
+/////////////////////////////////
+/// vector pixel::Correction: channels are biased by -32768 to signed 16 bit, so m0 * r + m1 * g is one madd
+/// of pair (r, g) and blue is paired with 0. limit of sum of modules of row keeps every sum in 32 bit,
+/// bias of channels is returned by constant of row, so result is the same as of scalar version.
+/// sse2 adds -32768 << BITS to constant and clamps by signed saturation of pack
+
+struct CorrectionConsts{
+	int black[3];
+	int m01[3];		/// pair (m[3c], m[3c + 1]) in 32 bit
+	int m2[3];		/// pair (m[3c + 2], 0)
+	int add[3];		/// 32768 * sum of row + ROUND + offset
+};
+
+/// c == 0 gives constants of zero correction (they are not used)
+static inline CorrectionConsts correction_consts(const pixel::Correction* c, int offset)
+{
+	CorrectionConsts res;
+	const pixel::Correction none = pixel::Correction();
+	if(!c)
+		c = &none;
+	for(int k = 0; k < 3; ++k){
+		const int* m = c->m + 3 * k;
+		res.black[k] = c->black[k];
+		res.m01[k] = (int)((m[0] & 0xffff) | ((uint)m[1] << 16));
+		res.m2[k] = m[2] & 0xffff;
+		res.add[k] = 0x8000 * (m[0] + m[1] + m[2]) + pixel::Correction::ROUND + offset;
+	}
+	return res;
+}
+
+/////////////////////////////////
+/// sse2: 8 pixels (4 bayer quads of two rows) by iteration.
+/// x0 is even and rows are aligned, so pixels of column (C, U, D, X) are read by aligned loads.
+/// division by 5 is made in float: sum < 2^19, the truncated product is exact
+
+SIMD_TARGET_SSE2
+static inline __m128i avg_floor_epu16(__m128i a, __m128i b)
+{
+	return _mm_add_epi16(_mm_and_si128(a, b), _mm_srli_epi16(_mm_xor_si128(a, b), 1));
+}
+
+/// load of 8 values of bayer with left shift
+SIMD_TARGET_SSE2
+static inline __m128i load_epu16(const ushort* d, __m128i lsh)
+{
+	return _mm_sll_epi16(_mm_loadu_si128(reinterpret_cast< const __m128i* >(d)), lsh);
+}
+
+/// the same from address aligned to 16 bytes
+SIMD_TARGET_SSE2
+static inline __m128i load_aligned_epu16(const ushort* d, __m128i lsh)
+{
+	return _mm_sll_epi16(_mm_load_si128(reinterpret_cast< const __m128i* >(d)), lsh);
+}
+
+SIMD_TARGET_SSE2
+static inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// 8 values of 32 bit in [0, 65535] to 16 bit: packed with signed saturation after bias
+SIMD_TARGET_SSE2
+static inline __m128i pack_epu32(__m128i lo, __m128i hi)
+{
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32)), bias16);
+}
+
+/// one channel of pixel::Correction of 4 pixels: madd of pairs (red, green) and (blue, 0), constant of row and shift
+SIMD_TARGET_SSE2
+static inline __m128i correct_pairs(__m128i rg, __m128i b0, __m128i m01, __m128i m2, __m128i add)
+{
+	return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg, m01), _mm_madd_epi16(b0, m2)), add),
+						  pixel::Correction::BITS);
+}
+
+/// pixel::Correction of 8 pixels of 16-bit channels (see correction_consts)
+SIMD_TARGET_SSE2
+static inline void correct(const __m128i* k, __m128i& red, __m128i& green, __m128i& blue)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	__m128i r = _mm_xor_si128(_mm_subs_epu16(red, k[0]), bias);
+	__m128i g = _mm_xor_si128(_mm_subs_epu16(green, k[1]), bias);
+	__m128i b = _mm_xor_si128(_mm_subs_epu16(blue, k[2]), bias);
+	__m128i rg0 = _mm_unpacklo_epi16(r, g);
+	__m128i rg1 = _mm_unpackhi_epi16(r, g);
+	__m128i b0 = _mm_unpacklo_epi16(b, zero);
+	__m128i b1 = _mm_unpackhi_epi16(b, zero);
+	__m128i res[3];
+	for(int c = 0; c < 3; ++c){
+		/// constant has -32768 of result: signed saturation of pack is clamp to [0, 65535] after bias
+		res[c] = _mm_xor_si128(_mm_packs_epi32(correct_pairs(rg0, b0, k[3 + c], k[6 + c], k[9 + c]),
+											   correct_pairs(rg1, b1, k[3 + c], k[6 + c], k[9 + c])), bias);
+	}
+	red = res[0];
+	green = res[1];
+	blue = res[2];
+}
+
+/// pixel::Correction of 8 pixels together with shift of tone curve (not more than 8, so clamp to 65535 does not change result):
+/// sum of channel is shifted once by BITS + shift and clamped to [0, 255] in 16 bit. add - constants of row without offset
+SIMD_TARGET_SSE2
+static inline void correct_tone(const __m128i* k, const __m128i* add, __m128i sh, __m128i& red, __m128i& green, __m128i& blue)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	const __m128i max8 = _mm_set1_epi16(MAX_UCHAR);
+	__m128i r = _mm_xor_si128(_mm_subs_epu16(red, k[0]), bias);
+	__m128i g = _mm_xor_si128(_mm_subs_epu16(green, k[1]), bias);
+	__m128i b = _mm_xor_si128(_mm_subs_epu16(blue, k[2]), bias);
+	__m128i rg0 = _mm_unpacklo_epi16(r, g);
+	__m128i rg1 = _mm_unpackhi_epi16(r, g);
+	__m128i b0 = _mm_unpacklo_epi16(b, zero);
+	__m128i b1 = _mm_unpackhi_epi16(b, zero);
+	__m128i res[3];
+	for(int c = 0; c < 3; ++c){
+		__m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg0, k[3 + c]), _mm_madd_epi16(b0, k[6 + c])), add[c]);
+		__m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg1, k[3 + c]), _mm_madd_epi16(b1, k[6 + c])), add[c]);
+		/// signed saturation of pack keeps sign and values over 255
+		__m128i v = _mm_packs_epi32(_mm_sra_epi32(lo, sh), _mm_sra_epi32(hi, sh));
+		res[c] = _mm_min_epi16(_mm_max_epi16(v, zero), max8);
+	}
+	red = res[0];
+	green = res[1];
+	blue = res[2];
+}
+
+/// 8 pixels of 16-bit channels to layout of pixel::Rgb16
+SIMD_TARGET_SSE2
+static inline void store_rgb16(void* out, __m128i red, __m128i green, __m128i blue)
+{
+	__m128i* d = reinterpret_cast< __m128i* >(out);
+	const __m128i alpha = _mm_set1_epi16(-1);
+	__m128i rg = _mm_unpacklo_epi16(red, green);
+	__m128i ba = _mm_unpacklo_epi16(blue, alpha);
+	_mm_storeu_si128(d, _mm_unpacklo_epi32(rg, ba));
+	_mm_storeu_si128(d + 1, _mm_unpackhi_epi32(rg, ba));
+	rg = _mm_unpackhi_epi16(red, green);
+	ba = _mm_unpackhi_epi16(blue, alpha);
+	_mm_storeu_si128(d + 2, _mm_unpacklo_epi32(rg, ba));
+	_mm_storeu_si128(d + 3, _mm_unpackhi_epi32(rg, ba));
+}
+
+/// 8 pixels of channels in [0, 255] in 16 bit to ARGB32
+SIMD_TARGET_SSE2
+static inline void store_argb(void* out, __m128i red, __m128i green, __m128i blue)
+{
+	__m128i* d = reinterpret_cast< __m128i* >(out);
+	const __m128i alpha = _mm_set1_epi16((short)0xff00);
+	__m128i bg = _mm_or_si128(blue, _mm_slli_epi16(green, 8));
+	__m128i ra = _mm_or_si128(red, alpha);
+	_mm_storeu_si128(d, _mm_unpacklo_epi16(bg, ra));
+	_mm_storeu_si128(d + 1, _mm_unpackhi_epi16(bg, ra));
+}
+
+template< int P, typename O >
+SIMD_TARGET_SSE2
+static int linear_row_sse2(const LinearRow& a, const O& o, typename O::Pixel* out, int x0, int x1)
+{
+	typedef cfa::Layout< P > L;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 k5 = _mm_set1_ps(1.f / 5);
+	const __m128i sh = _mm_cvtsi32_si128(a.shift);
+	const __m128i lsh = _mm_cvtsi32_si128(a.lshift);
+	const __m128i max8 = _mm_set1_epi16(MAX_UCHAR);
+	const __m128i max32 = _mm_set1_epi32(MAX_UCHAR);
+	const __m128i odd16 = _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+	/// row of blue
+	const bool odd = ((a.row + L::DY) & 1) != 0;
+	const bool use_lut = a.shift < 0;
+	/// correction and shift of tone are made by one shift of sums
+	const bool fused = a.cc && O::BITS == 8 && !use_lut && a.shift <= 8;
+	const __m128i fsh = _mm_cvtsi32_si128(pixel::Correction::BITS + a.shift);
+
+	/// lanes of green pixels (lane 0 is column x0): own color is interpolated, green by 5 points
+	const __m128i diag16 = ((a.row + L::DY + L::DX + x0) & 1)? _mm_xor_si128(odd16, _mm_set1_epi16(-1)) : odd16;
+	const __m128i diag32 = _mm_unpacklo_epi16(diag16, diag16);
+	/// neighbour rows interpolate own color in other lanes
+	const __m128i other16 = _mm_xor_si128(diag16, _mm_set1_epi16(-1));
+	const ushort* center = odd? a.b0 : a.bm2;
+
+	/// constants of correction (not used without it)
+	const CorrectionConsts cc = correction_consts(a.cc, -(0x8000 << pixel::Correction::BITS));
+	__m128i ck[12], fadd[3];
+	for(int c = 0; c < 3; ++c){
+		ck[c] = _mm_set1_epi16((short)cc.black[c]);
+		ck[3 + c] = _mm_set1_epi32(cc.m01[c]);
+		ck[6 + c] = _mm_set1_epi32(cc.m2[c]);
+		ck[9 + c] = _mm_set1_epi32(cc.add[c]);
+		fadd[c] = _mm_set1_epi32(cc.add[c] + (0x8000 << pixel::Correction::BITS));
+	}
+
+	int j = x0;
+	for(; j + 8 <= x1; j += 8){
+		__m128i W = load_epu16(a.b0 + j - 1, lsh);
+		__m128i C = load_aligned_epu16(a.b0 + j, lsh);
+		__m128i E = load_epu16(a.b0 + j + 1, lsh);
+		__m128i UL = load_epu16(a.bm1 + j - 1, lsh);
+		__m128i U = load_aligned_epu16(a.bm1 + j, lsh);
+		__m128i UR = load_epu16(a.bm1 + j + 1, lsh);
+		__m128i DL = load_epu16(a.bp1 + j - 1, lsh);
+		__m128i D = load_aligned_epu16(a.bp1 + j, lsh);
+		__m128i DR = load_epu16(a.bp1 + j + 1, lsh);
+		__m128i X = load_aligned_epu16(center + j, lsh);
+
+		/// red & blue
+		__m128i own = select_si128(diag16, avg_floor_epu16(W, E), C);
+		__m128i up = select_si128(other16, avg_floor_epu16(UL, UR), U);
+		__m128i dn = select_si128(other16, avg_floor_epu16(DL, DR), D);
+		__m128i other = avg_floor_epu16(up, dn);
+
+		/// green
+		__m128i g[2];
+		for(int k = 0; k < 2; ++k){
+			__m128i s4, s5;
+			if(k == 0){
+				s4 = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(U, zero), _mm_unpacklo_epi16(D, zero)),
+								   _mm_add_epi32(_mm_unpacklo_epi16(W, zero), _mm_unpacklo_epi16(E, zero)));
+				s5 = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(UL, zero), _mm_unpacklo_epi16(UR, zero)),
+								   _mm_add_epi32(_mm_unpacklo_epi16(DL, zero), _mm_unpacklo_epi16(DR, zero)));
+				s5 = _mm_add_epi32(s5, _mm_unpacklo_epi16(X, zero));
+			}else{
+				s4 = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(U, zero), _mm_unpackhi_epi16(D, zero)),
+								   _mm_add_epi32(_mm_unpackhi_epi16(W, zero), _mm_unpackhi_epi16(E, zero)));
+				s5 = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(UL, zero), _mm_unpackhi_epi16(UR, zero)),
+								   _mm_add_epi32(_mm_unpackhi_epi16(DL, zero), _mm_unpackhi_epi16(DR, zero)));
+				s5 = _mm_add_epi32(s5, _mm_unpackhi_epi16(X, zero));
+			}
+			__m128i g4 = _mm_srli_epi32(s4, 2);
+			__m128i g5 = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(s5), k5));
+			g[k] = select_si128(diag32, g5, g4);
+		}
+
+		if(fused){
+			__m128i red = odd? other : own;
+			__m128i blue = odd? own : other;
+			__m128i green = pack_epu32(g[0], g[1]);
+			correct_tone(ck, fadd, fsh, red, green, blue);
+			store_argb(out + j, red, green, blue);
+			continue;
+		}
+
+		if(a.cc){
+			__m128i red = odd? other : own;
+			__m128i blue = odd? own : other;
+			__m128i green = pack_epu32(g[0], g[1]);
+			correct(ck, red, green, blue);
+			g[0] = _mm_unpacklo_epi16(green, zero);
+			g[1] = _mm_unpackhi_epi16(green, zero);
+			own = odd? blue : red;
+			other = odd? red : blue;
+		}
+
+		if(O::BITS == 16){
+			/// green < 2^16
+			__m128i green = pack_epu32(g[0], g[1]);
+			store_rgb16(out + j, odd? other : own, green, odd? own : other);
+			continue;
+		}
+
+		if(use_lut){
+			/// arbitrary curve: values are taken from table
+			ushort vo[8], vt[8];
+			uint vg[8];
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vo), own);
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vt), other);
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vg), g[0]);
+			_mm_storeu_si128(reinterpret_cast< __m128i* >(vg + 4), g[1]);
+			const ushort* vr = odd? vt : vo;
+			const ushort* vb = odd? vo : vt;
+			for(int k = 0; k < 8; ++k){
+				out[j + k] = o(vr[k], vg[k], vb[k]);
+			}
+			continue;
+		}
+
+		own = _mm_srl_epi16(own, sh);
+		own = _mm_sub_epi16(own, _mm_subs_epu16(own, max8));
+		other = _mm_srl_epi16(other, sh);
+		other = _mm_sub_epi16(other, _mm_subs_epu16(other, max8));
+
+		for(int k = 0; k < 2; ++k){
+			__m128i v = _mm_srl_epi32(g[k], sh);
+			__m128i m = _mm_cmpgt_epi32(v, max32);
+			g[k] = select_si128(m, max32, v);
+		}
+		__m128i green = _mm_packs_epi32(g[0], g[1]);
+
+		store_argb(out + j, odd? other : own, green, odd? own : other);
+	}
+	return j;
+}
+
+/////////////////////////////////
+/// avx2: 16 pixels by iteration, the same scheme as sse2
+
+SIMD_TARGET_AVX2
+static inline __m256i avg_floor_epu16_avx2(__m256i a, __m256i b)
+{
+	return _mm256_add_epi16(_mm256_and_si256(a, b), _mm256_srli_epi16(_mm256_xor_si256(a, b), 1));
+}
+
+/// load of 16 values of bayer with left shift
+SIMD_TARGET_AVX2
+static inline __m256i load_epu16_avx2(const ushort* d, __m128i lsh)
+{
+	return _mm256_sll_epi16(_mm256_loadu_si256(reinterpret_cast< const __m256i* >(d)), lsh);
+}
+
+/// the same from address aligned to 32 bytes
+SIMD_TARGET_AVX2
+static inline __m256i load_aligned_epu16_avx2(const ushort* d, __m128i lsh)
+{
+	return _mm256_sll_epi16(_mm256_load_si256(reinterpret_cast< const __m256i* >(d)), lsh);
+}
+
+/// 8 values from low (k = 0) or high (k = 1) half of vector as 32 bit
+SIMD_TARGET_AVX2
+static inline __m256i half_epi32(__m256i v, int k)
+{
+	return _mm256_cvtepu16_epi32(k? _mm256_extracti128_si256(v, 1) : _mm256_castsi256_si128(v));
+}
+
+/// pixel::Correction of 8 pixels of 32 bit: pairs are (red, green) and (blue, 0) in lanes of 32 bit
+SIMD_TARGET_AVX2
+static inline __m256i correct_pairs_avx2(__m256i rg, __m256i b0, __m256i m01, __m256i m2, __m256i add)
+{
+	__m256i v = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg, m01), _mm256_madd_epi16(b0, m2)), add);
+	v = _mm256_max_epi32(_mm256_srai_epi32(v, pixel::Correction::BITS), _mm256_setzero_si256());
+	return _mm256_min_epi32(v, _mm256_set1_epi32(pixel::Correction::MAX));
+}
+
+SIMD_TARGET_AVX2
+static inline void correct_avx2(const __m256i* k, __m256i& red, __m256i& green, __m256i& blue)
+{
+	const __m256i bias = _mm256_set1_epi16((short)0x8000);
+	__m256i rg = _mm256_xor_si256(_mm256_subs_epu16(_mm256_or_si256(red, _mm256_slli_epi32(green, 16)), k[0]), bias);
+	__m256i b0 = _mm256_xor_si256(_mm256_subs_epu16(blue, k[1]), bias);
+	red = correct_pairs_avx2(rg, b0, k[2], k[5], k[8]);
+	green = correct_pairs_avx2(rg, b0, k[3], k[6], k[9]);
+	blue = correct_pairs_avx2(rg, b0, k[4], k[7], k[10]);
+}
+
+/// one channel of correct_tone_avx2: sum is shifted by BITS + shift of tone and clamped to [0, 255]
+SIMD_TARGET_AVX2
+static inline __m256i correct_tone_pairs_avx2(__m256i rg, __m256i b0, __m256i m01, __m256i m2, __m256i add, __m128i sh)
+{
+	__m256i v = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg, m01), _mm256_madd_epi16(b0, m2)), add);
+	v = _mm256_max_epi32(_mm256_sra_epi32(v, sh), _mm256_setzero_si256());
+	return _mm256_min_epi32(v, _mm256_set1_epi32(MAX_UCHAR));
+}
+
+/// pixel::Correction together with shift of tone curve (see correct_tone of sse2)
+SIMD_TARGET_AVX2
+static inline void correct_tone_avx2(const __m256i* k, __m128i sh, __m256i& red, __m256i& green, __m256i& blue)
+{
+	const __m256i bias = _mm256_set1_epi16((short)0x8000);
+	__m256i rg = _mm256_xor_si256(_mm256_subs_epu16(_mm256_or_si256(red, _mm256_slli_epi32(green, 16)), k[0]), bias);
+	__m256i b0 = _mm256_xor_si256(_mm256_subs_epu16(blue, k[1]), bias);
+	red = correct_tone_pairs_avx2(rg, b0, k[2], k[5], k[8], sh);
+	green = correct_tone_pairs_avx2(rg, b0, k[3], k[6], k[9], sh);
+	blue = correct_tone_pairs_avx2(rg, b0, k[4], k[7], k[10], sh);
+}
+
+template< int P, typename O >
+SIMD_TARGET_AVX2
+static int linear_row_avx2(const LinearRow& a, const O& o, typename O::Pixel* out, int x0, int x1)
+{
+	typedef cfa::Layout< P > L;
+	const __m256 k5 = _mm256_set1_ps(1.f / 5);
+	const __m128i sh = _mm_cvtsi32_si128(a.shift);
+	const __m128i lsh = _mm_cvtsi32_si128(a.lshift);
+	const __m256i max32 = _mm256_set1_epi32(MAX_UCHAR);
+	const __m256i alpha = _mm256_set1_epi32(MASK_ALPHAMAX_UCHAR);
+	const __m256i ones = _mm256_set1_epi16(-1);
+	const __m256i odd16 = _mm256_set_epi16(0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1);
+	const bool odd = ((a.row + L::DY) & 1) != 0;
+	const bool use_lut = a.shift < 0;
+	const bool fused = a.cc && O::BITS == 8 && !use_lut && a.shift <= 8;
+	const __m128i fsh = _mm_cvtsi32_si128(pixel::Correction::BITS + a.shift);
+	const int* lut = reinterpret_cast< const int* >(o.table());
+	const __m256i alpha16 = _mm256_set1_epi32(0xffff0000);
+
+	const __m256i diag16 = ((a.row + L::DY + L::DX + x0) & 1)? _mm256_xor_si256(odd16, ones) : odd16;
+	const __m256i diag32 = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(diag16));
+	const __m256i other16 = _mm256_xor_si256(diag16, ones);
+	const ushort* center = odd? a.b0 : a.bm2;
+
+	const CorrectionConsts cc = correction_consts(a.cc, 0);
+	__m256i ck[11];
+	ck[0] = _mm256_set1_epi32((int)((uint)cc.black[0] | ((uint)cc.black[1] << 16)));
+	ck[1] = _mm256_set1_epi32(cc.black[2]);
+	for(int c = 0; c < 3; ++c){
+		ck[2 + c] = _mm256_set1_epi32(cc.m01[c]);
+		ck[5 + c] = _mm256_set1_epi32(cc.m2[c]);
+		ck[8 + c] = _mm256_set1_epi32(cc.add[c]);
+	}
+
+	int j = x0;
+	for(; j + 16 <= x1; j += 16){
+		__m256i W = load_epu16_avx2(a.b0 + j - 1, lsh);
+		__m256i C = load_aligned_epu16_avx2(a.b0 + j, lsh);
+		__m256i E = load_epu16_avx2(a.b0 + j + 1, lsh);
+		__m256i UL = load_epu16_avx2(a.bm1 + j - 1, lsh);
+		__m256i U = load_aligned_epu16_avx2(a.bm1 + j, lsh);
+		__m256i UR = load_epu16_avx2(a.bm1 + j + 1, lsh);
+		__m256i DL = load_epu16_avx2(a.bp1 + j - 1, lsh);
+		__m256i D = load_aligned_epu16_avx2(a.bp1 + j, lsh);
+		__m256i DR = load_epu16_avx2(a.bp1 + j + 1, lsh);
+		__m256i X = load_aligned_epu16_avx2(center + j, lsh);
+
+		/// red & blue
+		__m256i own16 = _mm256_blendv_epi8(C, avg_floor_epu16_avx2(W, E), diag16);
+		__m256i up = _mm256_blendv_epi8(U, avg_floor_epu16_avx2(UL, UR), other16);
+		__m256i dn = _mm256_blendv_epi8(D, avg_floor_epu16_avx2(DL, DR), other16);
+		__m256i other_avg16 = avg_floor_epu16_avx2(up, dn);
+
+		/// 8 pixels of 32 bit by step
+		for(int k = 0; k < 2; ++k){
+			__m256i s4 = _mm256_add_epi32(_mm256_add_epi32(half_epi32(U, k), half_epi32(D, k)),
+										  _mm256_add_epi32(half_epi32(W, k), half_epi32(E, k)));
+			__m256i s5 = _mm256_add_epi32(_mm256_add_epi32(half_epi32(UL, k), half_epi32(UR, k)),
+										  _mm256_add_epi32(half_epi32(DL, k), half_epi32(DR, k)));
+			s5 = _mm256_add_epi32(s5, half_epi32(X, k));
+			__m256i g4 = _mm256_srli_epi32(s4, 2);
+			__m256i g5 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(s5), k5));
+
+			__m256i green = _mm256_blendv_epi8(g4, g5, diag32);
+			__m256i own = half_epi32(own16, k);
+			__m256i other = half_epi32(other_avg16, k);
+			__m256i red = odd? other : own;
+			__m256i blue = odd? own : other;
+			if(fused)
+				correct_tone_avx2(ck, fsh, red, green, blue);
+			else if(a.cc)
+				correct_avx2(ck, red, green, blue);
+
+			if(O::BITS == 16){
+				/// pixels 0, 1, 4, 5 and 2, 3, 6, 7 by lanes, then in order
+				__m256i rg = _mm256_or_si256(red, _mm256_slli_epi32(green, 16));
+				__m256i ba = _mm256_or_si256(blue, alpha16);
+				__m256i lo = _mm256_unpacklo_epi32(rg, ba);
+				__m256i hi = _mm256_unpackhi_epi32(rg, ba);
+				__m256i* d = reinterpret_cast< __m256i* >(out + j + 8 * k);
+				_mm256_storeu_si256(d, _mm256_permute2x128_si256(lo, hi, 0x20));
+				_mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+				continue;
+			}
+
+			if(use_lut){
+				/// arbitrary curve: gather from table (it has padding for reading of 4 bytes)
+				green = _mm256_and_si256(_mm256_i32gather_epi32(lut, green, 1), max32);
+				red = _mm256_and_si256(_mm256_i32gather_epi32(lut, red, 1), max32);
+				blue = _mm256_and_si256(_mm256_i32gather_epi32(lut, blue, 1), max32);
+			}else if(!fused){
+				green = _mm256_min_epi32(_mm256_srl_epi32(green, sh), max32);
+				red = _mm256_min_epi32(_mm256_srl_epi32(red, sh), max32);
+				blue = _mm256_min_epi32(_mm256_srl_epi32(blue, sh), max32);
+			}
+
+			__m256i px = _mm256_or_si256(_mm256_or_si256(blue, _mm256_slli_epi32(green, 8)),
+										 _mm256_or_si256(_mm256_slli_epi32(red, 16), alpha));
+			_mm256_storeu_si256(reinterpret_cast< __m256i* >(out + j + 8 * k), px);
+		}
+	}
+	return j;
+}
+
+#endif
+
+/////////////////////////////////
+
+template< int P, typename O >
+static void linear_cfa(const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+					   const O& o, int shift, uchar *image, int bpl, LEVEL level, int y0, int y1)
+{
+	y0 = qMax(y0, 0);
+	y1 = qMin(y1, height);
+
+	/// every row, border too, by the same loop: neighbours out of frame are in halo
+	for(int i = y0; i < y1; ++i){
+		typename O::Pixel* out = reinterpret_cast< typename O::Pixel* >(image + (qint64)i * bpl);
+
+		LinearRow a = {
+			bayer + (qint64)(i - 2) * stride,
+			bayer + (qint64)(i - 1) * stride,
+			bayer + (qint64)i * stride,
+			bayer + (qint64)(i + 1) * stride,
+			i, lshift, shift, correction
+		};
+		int j = 0;
+
+#if defined(SIMD_X86)
+		if(level >= AVX2)
+			j = linear_row_avx2< P >(a, o, out, j, width);
+		/// rest of row (and whole row without avx2) by sse2
+		if(level >= SSE2)
+			j = linear_row_sse2< P >(a, o, out, j, width);
+#else
+		Q_UNUSED(level);
+#endif
+
+		linear_row_scalar< P >(a, o, out, j, width);
+	}
+}
+
+template< typename O >
+static void linear_pattern(const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+						   const O& o, int shift, cfa::PATTERN pattern, uchar *image, int bpl, LEVEL level, int y0, int y1)
+{
+	switch (pattern) {
+		case cfa::RGGB:
+			linear_cfa< cfa::RGGB >(bayer, stride, width, height, lshift, correction, o, shift, image, bpl, level, y0, y1);
+			break;
+		case cfa::BGGR:
+			linear_cfa< cfa::BGGR >(bayer, stride, width, height, lshift, correction, o, shift, image, bpl, level, y0, y1);
+			break;
+		case cfa::GBRG:
+			linear_cfa< cfa::GBRG >(bayer, stride, width, height, lshift, correction, o, shift, image, bpl, level, y0, y1);
+			break;
+		case cfa::GRBG:
+		default:
+			linear_cfa< cfa::GRBG >(bayer, stride, width, height, lshift, correction, o, shift, image, bpl, level, y0, y1);
+			break;
+	}
+}
+
+void linear(const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+			const ToneCurve& tone, cfa::PATTERN pattern, uchar *image, int bpl, LEVEL level, int y0, int y1)
+{
+	if(!linear_supported(width, height))
+		return;
+	Q_ASSERT(!(reinterpret_cast< quintptr >(bayer) & 31) && !(stride & 15));
+
+	const pixel::Tone8 o = { tone.lut() };
+	/// pure shift is computed in vector registers, other curves are taken from table
+	const int shift = tone.is_shift()? tone.shift() : -1;
+
+	linear_pattern(bayer, stride, width, height, lshift, correction, o, shift, pattern, image, bpl, level, y0, y1);
+}
+
+void linear_rgb16(const ushort *bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+				  cfa::PATTERN pattern, uchar *rgb, int bpl, LEVEL level, int y0, int y1)
+{
+	if(!linear_supported(width, height))
+		return;
+	Q_ASSERT(!(reinterpret_cast< quintptr >(bayer) & 31) && !(stride & 15));
+
+	linear_pattern(bayer, stride, width, height, lshift, correction, pixel::Rgb16(), -1, pattern, rgb, bpl, level, y0, y1);
+}
+
+/////////////////////////////////
+/// tone mapping of pixel::Rgb16 to ARGB32
+
+static void tone_map_scalar(const quint64* in, const uchar* lut, uint* out, int x0, int x1)
+{
+	const pixel::Tone8 o = { lut };
+	for(int j = x0; j < x1; ++j){
+		const quint64 p = in[j];
+		out[j] = o(p & 0xffff, (p >> 16) & 0xffff, (p >> 32) & 0xffff);
+	}
+}
+
+#if defined(SIMD_X86)
+
+/// pure shift: 4 pixels by iteration. channels R, G, B, A are swapped to B, G, R, A and packed to bytes
+SIMD_TARGET_SSE2
+static int tone_shift_sse2(const quint64* in, int shift, uint* out, int x0, int x1)
+{
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+	const __m128i max8 = _mm_set1_epi16(MAX_UCHAR);
+	const __m128i alpha = _mm_set1_epi32(MASK_ALPHAMAX_UCHAR);
+
+	int j = x0;
+	for(; j + 4 <= x1; j += 4){
+		__m128i v[2];
+		for(int k = 0; k < 2; ++k){
+			__m128i p = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast< const __m128i* >(in + j + 2 * k)), sh);
+			p = _mm_sub_epi16(p, _mm_subs_epu16(p, max8));
+			p = _mm_shufflelo_epi16(p, _MM_SHUFFLE(3, 0, 1, 2));
+			v[k] = _mm_shufflehi_epi16(p, _MM_SHUFFLE(3, 0, 1, 2));
+		}
+		__m128i px = _mm_or_si128(_mm_packus_epi16(v[0], v[1]), alpha);
+		_mm_storeu_si128(reinterpret_cast< __m128i* >(out + j), px);
+	}
+	return j;
+}
+
+/// the same by 8 pixels
+SIMD_TARGET_AVX2
+static int tone_shift_avx2(const quint64* in, int shift, uint* out, int x0, int x1)
+{
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+	const __m256i max8 = _mm256_set1_epi16(MAX_UCHAR);
+	const __m256i alpha = _mm256_set1_epi32(MASK_ALPHAMAX_UCHAR);
+
+	int j = x0;
+	for(; j + 8 <= x1; j += 8){
+		__m256i v[2];
+		for(int k = 0; k < 2; ++k){
+			__m256i p = _mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast< const __m256i* >(in + j + 4 * k)), sh);
+			p = _mm256_min_epu16(p, max8);
+			p = _mm256_shufflelo_epi16(p, _MM_SHUFFLE(3, 0, 1, 2));
+			v[k] = _mm256_shufflehi_epi16(p, _MM_SHUFFLE(3, 0, 1, 2));
+		}
+		/// pack by lanes gives pixels 0, 1, 4, 5, 2, 3, 6, 7
+		__m256i px = _mm256_permute4x64_epi64(_mm256_packus_epi16(v[0], v[1]), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(out + j), _mm256_or_si256(px, alpha));
+	}
+	return j;
+}
+
+#endif
+
+void tone_map(const uchar *rgb, int rgb_bpl, int width, const ToneCurve &tone, uchar *image, int bpl,
+			  LEVEL level, int y0, int y1)
+{
+	const int shift = tone.is_shift()? tone.shift() : -1;
+
+	for(int i = y0; i < y1; ++i){
+		const quint64* in = reinterpret_cast< const quint64* >(rgb + (qint64)i * rgb_bpl);
+		uint* out = reinterpret_cast< uint* >(image + (qint64)i * bpl);
+		int j = 0;
+
+#if defined(SIMD_X86)
+		if(shift >= 0 && level >= AVX2)
+			j = tone_shift_avx2(in, shift, out, j, width);
+		if(shift >= 0 && level >= SSE2)
+			j = tone_shift_sse2(in, shift, out, j, width);
+#else
+		Q_UNUSED(level);
+#endif
+
+		tone_map_scalar(in, tone.lut(), out, j, width);
+	}
+}
+
+}
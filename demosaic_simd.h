@@ -0,0 +1,95 @@
+#ifndef DEMOSAIC_SIMD_H
+#define DEMOSAIC_SIMD_H
+
+#include <QtGlobal>
+
+#include "cfa.h"
+
+class ToneCurve;
+
+namespace pixel{
+struct Correction;
+}
+
+namespace simd{
+
+enum LEVEL{
+	SCALAR = 0,
+	SSE2,
+	AVX2
+};
+
+/**
+ * @brief level
+ * лучший набор инструкций текущего процессора (определяется один раз при старте)
+ * @return
+ */
+LEVEL level();
+/**
+ * @brief level_name
+ * @param value
+ * @return
+ */
+const char* level_name(LEVEL value);
+
+/**
+ * @brief linear_supported
+ * frame geometry handled by simd::linear (not less than 8, odd sizes are allowed)
+ * @param width
+ * @param height
+ * @return
+ */
+bool linear_supported(int width, int height);
+/**
+ * @brief linear
+ * bilinear demoscaling, result is bit-exact with RawReader::demoscaling_linear (for GRBG).
+ * left shift, interpolation and tone mapping are made in one pass over source frame,
+ * the whole row (border too) is handled by 8 (sse2) or 16 (avx2) pixels without checks.
+ * rows are independent: only rows [y0, y1) of output are written, so the frame may be split
+ * to bands between threads (neighbour rows of bayer are read as is)
+ * @param bayer - pixel (0, 0) of bayer frame with mirrored halo of cfa::HALO pixels (see Mat::fill_halo),
+ * aligned to 32 bytes
+ * @param stride - elements from row to row, multiple of 16
+ * @param width
+ * @param height
+ * @param lshift - left shift of source value (result is cut to 16 bit)
+ * @param correction - black level, white balance and color matrix applied to interpolated channels
+ * in fixed point before output (the same result on all levels), 0 - none
+ * @param tone - 16 to 8 bit conversion (table must be updated)
+ * @param pattern - layout of color filter (kernels are instantiated for every pattern)
+ * @param image - ARGB32 output
+ * @param bpl - bytes per line of output
+ * @param level - instruction set
+ * @param y0 - first row of output
+ * @param y1 - row after last
+ */
+void linear(const ushort* bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+			const ToneCurve& tone, cfa::PATTERN pattern, uchar* image, int bpl, LEVEL level, int y0, int y1);
+/**
+ * @brief linear_rgb16
+ * the same without tone mapping: 16 bit by channel (layout of QRgba64, see pixel::Rgb16)
+ * @param rgb - output of 8 bytes by pixel
+ * @param bpl - bytes per line of output
+ */
+void linear_rgb16(const ushort* bayer, int stride, int width, int height, int lshift, const pixel::Correction* correction,
+				  cfa::PATTERN pattern, uchar* rgb, int bpl, LEVEL level, int y0, int y1);
+/**
+ * @brief tone_map
+ * conversion of 16-bit output of demoscaling (pixel::Rgb16) to ARGB32.
+ * pure shift is vectorized, other curves are taken from table by pixel
+ * @param rgb - input of 8 bytes by pixel
+ * @param rgb_bpl - bytes per line of input
+ * @param width
+ * @param tone - 16 to 8 bit conversion (table must be updated)
+ * @param image - ARGB32 output
+ * @param bpl - bytes per line of output
+ * @param level - instruction set
+ * @param y0 - first row
+ * @param y1 - row after last
+ */
+void tone_map(const uchar* rgb, int rgb_bpl, int width, const ToneCurve& tone, uchar* image, int bpl,
+			  LEVEL level, int y0, int y1);
+
+}
+
+#endif // DEMOSAIC_SIMD_H
@@ -0,0 +1,274 @@
+#include "framecache.h"
+
+#include <QRunnable>
+#include <QElapsedTimer>
+
+#include <limits.h>
+
+/////////////////////////////////
+/// \brief The PrefetchTask class
+/// one file: reading, demoscaling and tone mapping by own RawReader in one thread
+
+class PrefetchTask: public QRunnable{
+public:
+	PrefetchTask(FrameCache* owner, const QString& fileName, const RawReader::Settings& settings, int generation)
+		: m_owner(owner)
+		, m_fileName(fileName)
+		, m_settings(settings)
+		, m_generation(generation)
+	{
+	}
+	virtual void run(){
+		FrameCache::Frame frame;
+		RawReader reader;
+		RawReader::Settings settings = m_settings;
+		/// file is opened from the first frame; one thread, so neighbours do not hold back the current file
+		settings.frame = 0;
+		settings.threads = 1;
+		reader.apply(settings);
+		reader.set_size(settings.width, settings.height);
+		/// superseded task is not computed, but it is reported to free its place
+		if(!m_owner->started(&reader, m_fileName, m_generation)){
+			m_owner->decoded(m_fileName, m_generation, frame, &reader);
+			return;
+		}
+		QElapsedTimer timer;
+		timer.start();
+		const bool opened = reader.open_file(m_fileName);
+		frame.info.time_load = timer.elapsed();
+		if(opened && reader.compute()){
+			frame.image = reader.image();
+			frame.info.size = QSize(reader.width(), reader.height());
+			frame.info.time_exec = timer.elapsed() - frame.info.time_load;
+			frame.info.time_per_mp = reader.time_per_mp();
+			frame.info.thread_times = reader.thread_times();
+			frame.stats = reader.stats();
+			frame.shift = reader.shift();
+		}
+		/// failed or canceled file is reported too, to free its place
+		m_owner->decoded(m_fileName, m_generation, frame, &reader);
+	}
+
+private:
+	FrameCache* m_owner;
+	QString m_fileName;
+	RawReader::Settings m_settings;
+	int m_generation;
+};
+
+/////////////////////////////////
+/// parameters which change the result (frame and threads do not, size is read from file except RAW_TYPE_2)
+
+static bool same_output(const RawReader::Settings& a, const RawReader::Settings& b)
+{
+	const bool size = a.type != RawReader::RAW_TYPE_2 || (a.width == b.width && a.height == b.height);
+	return a.type == b.type && size && a.format == b.format
+			&& a.shift == b.shift && a.auto_shift == b.auto_shift && a.lshift == b.lshift
+			&& a.demoscaling == b.demoscaling && a.pattern == b.pattern && a.color == b.color
+			&& a.simd_level == b.simd_level && a.curve == b.curve && a.gamma == b.gamma
+			&& a.log_scale == b.log_scale && a.points == b.points;
+}
+
+/////////////////////////////////
+
+FrameCache::Frame::Frame()
+	: shift(0)
+{
+}
+
+FrameCache::FrameCache()
+	: m_valid(false)
+	, m_generation(0)
+	, m_running(0)
+	, m_frame_cost(0)
+	, m_hits(0)
+	, m_misses(0)
+{
+	set_budget(512);
+	/// the other half of cores is left to the current file
+	m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+FrameCache::~FrameCache()
+{
+	{
+		/// tasks hold pointer to this, results are dropped
+		QMutexLocker lock(&m_mutex);
+		next_generation();
+	}
+	m_pool.waitForDone();
+}
+
+void FrameCache::set_budget(int megabytes)
+{
+	QMutexLocker lock(&m_mutex);
+	m_frames.setMaxCost(qMax(1, megabytes) * 1024);
+}
+
+int FrameCache::budget() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_frames.maxCost() / 1024;
+}
+
+bool FrameCache::find(const QString &fileName, const RawReader::Settings &settings, FrameCache::Frame &frame)
+{
+	QMutexLocker lock(&m_mutex);
+	use_settings(settings);
+
+	if(m_decoding.value(fileName, -1) == m_generation){
+		/// file in prefetch: caller does not wait for one thread, task stops at next strip
+		m_decoding.remove(fileName);
+		m_running--;
+		foreach (RawReader* reader, m_readers.keys(fileName)) {
+			reader->cancel();
+		}
+	}
+
+	const Frame* value = m_frames.object(fileName);
+	if(!value){
+		/// it is decoded by caller
+		m_files.removeAll(fileName);
+		m_misses++;
+		return false;
+	}
+	m_hits++;
+	frame = *value;
+	return true;
+}
+
+void FrameCache::insert(const QString &fileName, const RawReader::Settings &settings, const FrameCache::Frame &frame)
+{
+	if(frame.image.isNull())
+		return;
+
+	QMutexLocker lock(&m_mutex);
+	use_settings(settings);
+	m_frame_cost = cost(frame);
+	m_frames.insert(fileName, new Frame(frame), m_frame_cost);
+}
+
+void FrameCache::remove(const QString &fileName)
+{
+	QMutexLocker lock(&m_mutex);
+	m_frames.remove(fileName);
+}
+
+void FrameCache::clear()
+{
+	QMutexLocker lock(&m_mutex);
+	next_generation();
+}
+
+void FrameCache::prefetch(const QString &current, const QStringList &files, const RawReader::Settings &settings)
+{
+	QMutexLocker lock(&m_mutex);
+	use_settings(settings);
+
+	/// files over budget would remove nearer ones; size of files is estimated by the last frame
+	const int count = m_frame_cost > 0? qBound(0, m_frames.maxCost() / m_frame_cost - 1, files.size()) : files.size();
+	m_files = files.mid(0, count);
+
+	/// far files are removed first
+	for(int i = m_files.size() - 1; i >= 0; --i){
+		m_frames.object(m_files[i]);
+	}
+	m_frames.object(current);
+	m_files.removeAll(current);
+
+	schedule();
+}
+
+int FrameCache::hits() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_hits;
+}
+
+int FrameCache::misses() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_misses;
+}
+
+qint64 FrameCache::bytes() const
+{
+	QMutexLocker lock(&m_mutex);
+	return (qint64)m_frames.totalCost() * 1024;
+}
+
+bool FrameCache::started(RawReader *reader, const QString &fileName, int generation)
+{
+	QMutexLocker lock(&m_mutex);
+	if(m_decoding.value(fileName, -1) != generation || generation != m_generation)
+		return false;
+	m_readers.insert(reader, fileName);
+	return true;
+}
+
+void FrameCache::decoded(const QString &fileName, int generation, const FrameCache::Frame &frame, RawReader *reader)
+{
+	QMutexLocker lock(&m_mutex);
+	m_readers.remove(reader);
+	/// task of file which is taken by find() or of previous generation does not hold thread
+	if(m_decoding.value(fileName, -1) == generation){
+		m_decoding.remove(fileName);
+		if(generation == m_generation)
+			m_running--;
+	}
+
+	if(generation == m_generation && !frame.image.isNull()){
+		m_frame_cost = cost(frame);
+		m_frames.insert(fileName, new Frame(frame), m_frame_cost);
+	}
+
+	schedule();
+}
+
+void FrameCache::use_settings(const RawReader::Settings &settings)
+{
+	if(m_valid && same_output(settings, m_settings))
+		return;
+
+	/// decoding of previous parameters ends, its results are dropped
+	m_settings = settings;
+	m_valid = true;
+	next_generation();
+}
+
+void FrameCache::next_generation()
+{
+	m_generation++;
+	m_frames.clear();
+	m_files.clear();
+	/// tasks of previous generation do not hold threads of new ones
+	m_running = 0;
+	foreach (RawReader* reader, m_readers.keys()) {
+		reader->cancel();
+	}
+}
+
+void FrameCache::schedule()
+{
+	for(int i = 0; i < m_files.size() && m_running < m_pool.maxThreadCount(); ){
+		const QString& fileName = m_files[i];
+		/// task of previous generation does not hold file, its result is dropped
+		if(m_frames.contains(fileName) || m_decoding.value(fileName, -1) == m_generation){
+			++i;
+			continue;
+		}
+		PrefetchTask* task = new PrefetchTask(this, fileName, m_settings, m_generation);
+		task->setAutoDelete(true);
+		m_decoding.insert(fileName, m_generation);
+		m_running++;
+		m_files.removeAt(i);
+		m_pool.start(task);
+	}
+}
+
+int FrameCache::cost(const FrameCache::Frame &frame)
+{
+	/// byteCount() is int, frames over 2 GB are counted in 64 bit
+	const qint64 bytes = (qint64)frame.image.bytesPerLine() * frame.image.height() + sizeof(RawStats);
+	return (int)qBound< qint64 >(1, bytes / 1024, INT_MAX);
+}
@@ -0,0 +1,126 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+
+#include "rawreader.h"
+
+///////////////////////////////////////////////
+/// \brief The FrameCache class
+/// decoded files (image after tone mapping with statistics of raw) for one set of parameters,
+/// least recently used files are removed over budget of memory.
+/// files near the current one are decoded ahead by pool of threads (one RawReader per file, one thread each),
+/// so stepping through folder shows them at once. all methods are thread safe
+///
+
+class FrameCache
+{
+public:
+	/// result of file, as it is published by worker
+	struct Frame{
+		Frame();
+
+		QImage image;
+		FrameInfo info;		/// size of frame and times of its decoding
+		RawStats stats;
+		int shift;			/// shift of tone curve (auto_shift)
+	};
+
+	FrameCache();
+	~FrameCache();
+
+	/**
+	 * @brief set_budget
+	 * memory of images, least recently used are removed
+	 * @param megabytes
+	 */
+	void set_budget(int megabytes);
+	int budget() const;
+
+	/**
+	 * @brief find
+	 * frame of file with parameters, it becomes the most recent.
+	 * cache is cleared if parameters are other than parameters of frames (frame and threads are not compared).
+	 * file which is decoded ahead just now is not waited for: its task (one thread) is canceled
+	 * and the caller decodes it by all threads
+	 * @param fileName
+	 * @param settings
+	 * @param frame
+	 * @return false if file is not in cache
+	 */
+	bool find(const QString& fileName, const RawReader::Settings& settings, Frame& frame);
+	/// frame decoded by other reader (worker) with the same parameters
+	void insert(const QString& fileName, const RawReader::Settings& settings, const Frame& frame);
+	/// file is read again on next find (e.g. it is rewritten)
+	void remove(const QString& fileName);
+	void clear();
+
+	/**
+	 * @brief prefetch
+	 * files to decode ahead, the nearest first. current file and then files become the most recent
+	 * (the nearest are removed last), files which would not fit into budget are not decoded.
+	 * files of previous list which are not started are dropped
+	 * @param current - file shown now (it is not decoded here)
+	 * @param files
+	 * @param settings
+	 */
+	void prefetch(const QString& current, const QStringList& files, const RawReader::Settings& settings);
+
+	int hits() const;
+	int misses() const;
+	/// images in cache
+	qint64 bytes() const;
+
+	/**
+	 * @brief started
+	 * called by task of file: reader is canceled when parameters are changed or file is requested by find()
+	 * @return false if task is of previous parameters or file is taken by find() (it is not computed)
+	 */
+	bool started(RawReader* reader, const QString& fileName, int generation);
+	/// called by task of file
+	void decoded(const QString& fileName, int generation, const Frame& frame, RawReader* reader);
+
+private:
+	mutable QMutex m_mutex;
+
+	/// cost of frame is KB
+	QCache< QString, Frame > m_frames;
+	/// parameters of frames in cache and of decoding
+	RawReader::Settings m_settings;
+	bool m_valid;
+	/// frames of previous parameters are dropped
+	int m_generation;
+
+	/// files of prefetch, the nearest first
+	QStringList m_files;
+	/// files in decoding and generation of their tasks
+	QHash< QString, int > m_decoding;
+	/// tasks of current generation: only they take threads of pool
+	int m_running;
+	/// readers of running tasks and their files, canceled ones stop at next strip
+	QHash< RawReader*, QString > m_readers;
+	/// cost of the last decoded frame, estimation of files of queue
+	int m_frame_cost;
+
+	int m_hits;
+	int m_misses;
+
+	QThreadPool m_pool;
+
+	/// cache is cleared if settings are changed (m_mutex is locked)
+	void use_settings(const RawReader::Settings& settings);
+	/// frames of previous parameters are dropped, their decoding is canceled (m_mutex is locked)
+	void next_generation();
+	/// tasks of queue while there are free threads and budget (m_mutex is locked)
+	void schedule();
+	static int cost(const Frame& frame);
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,277 @@
+#include "frameindex.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSet>
+#include <QDateTime>
+#include <QDataStream>
+#include <QtEndian>
+
+/// "RRIX", version of format (2: format of samples after header)
+static const quint32 index_magic = 0x58495252;
+static const quint32 index_version = 2;
+/// size of header of frame: width and height
+static const qint64 frame_header = 2 * sizeof(qint32);
+/// block of reading for checksums
+static const qint64 read_block = 4 << 20;
+
+/// files which are indexed now (player and worker may open the same file at once)
+static QMutex building_mutex;
+static QWaitCondition building_done;
+static QSet< QString > building;
+
+FrameIndex::FrameIndex()
+	: m_file_size(0)
+	, m_modified(0)
+	, m_checksum(false)
+{
+}
+
+bool FrameIndex::open(const QString &fileName, const RawFormat &format)
+{
+	if(fileName == m_fileName && format == m_format && !m_entries.isEmpty() && is_actual())
+		return true;
+
+	{
+		/// index of other thread is waited for, then it is loaded from its sidecar
+		QMutexLocker lock(&building_mutex);
+		while(building.contains(fileName))
+			building_done.wait(&building_mutex);
+		building.insert(fileName);
+	}
+
+	/// frames of other format have other offsets
+	bool res = load(fileName) && m_format == format;
+	if(!res && build(fileName, format)){
+		/// single frame does not need index on disk; directory may be read-only
+		if(m_entries.size() > 1)
+			save();
+		res = true;
+	}
+
+	QMutexLocker lock(&building_mutex);
+	building.remove(fileName);
+	building_done.wakeAll();
+	return res;
+}
+
+bool FrameIndex::build(const QString &fileName, const RawFormat &format, bool checksum)
+{
+	clear();
+
+	if(!format.is_valid())
+		return false;
+
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly))
+		return false;
+
+	const qint64 file_size = file.size();
+	QVector< Entry > entries;
+	QByteArray block;
+
+	qint64 offset = 0;
+	while(offset + frame_header <= file_size){
+		uchar header[frame_header];
+		if(!file.seek(offset) || file.read(reinterpret_cast< char* >(header), frame_header) != frame_header)
+			break;
+
+		Entry entry;
+		entry.offset = offset;
+		entry.width = qFromLittleEndian< qint32 >(header);
+		entry.height = qFromLittleEndian< qint32 >(header + sizeof(qint32));
+		entry.checksum = 0;
+		/// the same limits as in RawReader: other data is not a frame
+		if(entry.width <= 0 || entry.height <= 0 || entry.width > 0xffffff || entry.height > 0xffffff)
+			break;
+
+		const qint64 payload = format.frame_bytes(entry.width, entry.height);
+		/// garbage after frames (or not a stream) is not indexed as frames far over file
+		if(!RawFormat::is_present(payload, file_size - offset - frame_header))
+			break;
+
+		if(checksum){
+			quint32 value = 1;
+			qint64 rest = qMin(payload, file_size - offset - frame_header);
+			while(rest > 0){
+				block = file.read(qMin(rest, read_block));
+				if(block.isEmpty())
+					break;
+				value = adler32(reinterpret_cast< const uchar* >(block.constData()), block.size(), value);
+				rest -= block.size();
+			}
+			entry.checksum = value;
+		}
+
+		entries.push_back(entry);
+		offset += frame_header + payload;
+	}
+
+	if(entries.isEmpty())
+		return false;
+
+	QFileInfo info(fileName);
+	m_fileName = fileName;
+	m_file_size = file_size;
+	m_modified = info.lastModified().toMSecsSinceEpoch();
+	m_checksum = checksum;
+	m_format = format;
+	m_entries = entries;
+	return true;
+}
+
+bool FrameIndex::load(const QString &fileName)
+{
+	clear();
+
+	QFile file(sidecar(fileName));
+	if(!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setByteOrder(QDataStream::LittleEndian);
+
+	quint32 magic = 0, version = 0, checksum = 0;
+	qint64 file_size = 0, modified = 0;
+	qint32 count = 0;
+	stream >> magic >> version >> file_size >> modified >> checksum;
+	if(stream.status() != QDataStream::Ok || magic != index_magic || version != index_version)
+		return false;
+
+	RawFormat format;
+	qint32 bits = 0, packing = 0, endian = 0;
+	stream >> bits >> packing >> endian >> format.header >> format.stride >> count;
+	format.bits = bits;
+	format.packing = (RawFormat::PACKING)packing;
+	format.endian = (RawFormat::ENDIAN)endian;
+	if(stream.status() != QDataStream::Ok || !format.is_valid() || count <= 0)
+		return false;
+	/// entry is offset, width, height and checksum
+	if((qint64)count * 20 > file.size())
+		return false;
+
+	QVector< Entry > entries(count);
+	for(int i = 0; i < count; ++i){
+		Entry& e = entries[i];
+		stream >> e.offset >> e.width >> e.height >> e.checksum;
+	}
+	if(stream.status() != QDataStream::Ok)
+		return false;
+
+	m_fileName = fileName;
+	m_file_size = file_size;
+	m_modified = modified;
+	m_checksum = checksum != 0;
+	m_format = format;
+	m_entries = entries;
+
+	/// file is changed after index
+	if(!is_actual()){
+		clear();
+		return false;
+	}
+	return true;
+}
+
+bool FrameIndex::save() const
+{
+	if(m_entries.isEmpty())
+		return false;
+
+	QSaveFile file(sidecar(m_fileName));
+	if(!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setByteOrder(QDataStream::LittleEndian);
+
+	stream << index_magic << index_version << m_file_size << m_modified
+		   << (quint32)(m_checksum? 1 : 0)
+		   << (qint32)m_format.bits << (qint32)m_format.packing << (qint32)m_format.endian
+		   << m_format.header << m_format.stride << (qint32)m_entries.size();
+	foreach (const Entry& e, m_entries) {
+		stream << e.offset << e.width << e.height << e.checksum;
+	}
+	if(stream.status() != QDataStream::Ok){
+		file.cancelWriting();
+		return false;
+	}
+	return file.commit();
+}
+
+void FrameIndex::clear()
+{
+	m_fileName.clear();
+	m_file_size = 0;
+	m_modified = 0;
+	m_checksum = false;
+	m_format = RawFormat();
+	m_entries.clear();
+}
+
+QString FrameIndex::fileName() const
+{
+	return m_fileName;
+}
+
+const RawFormat &FrameIndex::format() const
+{
+	return m_format;
+}
+
+int FrameIndex::size() const
+{
+	return m_entries.size();
+}
+
+bool FrameIndex::empty() const
+{
+	return m_entries.isEmpty();
+}
+
+bool FrameIndex::has_checksum() const
+{
+	return m_checksum;
+}
+
+const FrameIndex::Entry &FrameIndex::at(int index) const
+{
+	return m_entries[index];
+}
+
+qint64 FrameIndex::bytes(int index) const
+{
+	const Entry& e = m_entries[index];
+	return qMin(frame_header + m_format.frame_bytes(e.width, e.height), m_file_size - e.offset);
+}
+
+QString FrameIndex::sidecar(const QString &fileName)
+{
+	return fileName + ".idx";
+}
+
+quint32 FrameIndex::adler32(const uchar *data, qint64 size, quint32 value)
+{
+	/// sums are reduced after 5552 bytes, as in zlib
+	quint32 a = value & 0xffff, b = value >> 16;
+	while(size > 0){
+		int n = (int)qMin< qint64 >(size, 5552);
+		size -= n;
+		while(n--){
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+bool FrameIndex::is_actual() const
+{
+	QFileInfo info(m_fileName);
+	return info.exists() && info.size() == m_file_size && info.lastModified().toMSecsSinceEpoch() == m_modified;
+}
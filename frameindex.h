@@ -0,0 +1,81 @@
+#ifndef FRAMEINDEX_H
+#define FRAMEINDEX_H
+
+#include <QString>
+#include <QVector>
+
+#include "rawformat.h"
+
+///////////////////////////////////////////////
+/// \brief The FrameIndex class
+/// frames of stream of RAW_TYPE_1 (header width, height and payload, one after another).
+/// index is built by one pass over headers and saved next to file ("<file>.idx"),
+/// so any frame is found without reading of headers before it
+///
+
+class FrameIndex
+{
+public:
+	struct Entry{
+		qint64 offset;		/// begin of header of frame in file
+		qint32 width;
+		qint32 height;
+		quint32 checksum;	/// adler32 of payload, 0 if index is built without checksums
+	};
+
+	FrameIndex();
+	/**
+	 * @brief open
+	 * index of file: the same one, sidecar if it is valid for file and format, otherwise it is built.
+	 * sidecar is saved only for more than one frame.
+	 * file is indexed by one thread at once: others wait for it and take its sidecar
+	 * @param fileName
+	 * @param format - size of payload of frame
+	 * @return false if file is not a stream of frames
+	 */
+	bool open(const QString& fileName, const RawFormat& format = RawFormat());
+	/**
+	 * @brief build
+	 * one pass over file: payloads are skipped (or read for checksums).
+	 * truncated last frame is in index (its tail is zero on reading)
+	 * @param fileName
+	 * @param format
+	 * @param checksum
+	 * @return
+	 */
+	bool build(const QString& fileName, const RawFormat& format = RawFormat(), bool checksum = false);
+	bool load(const QString& fileName);
+	/// sidecar is written to temporary file and renamed, so reader never sees a partial one
+	bool save() const;
+	void clear();
+
+	QString fileName() const;
+	const RawFormat& format() const;
+	int size() const;
+	bool empty() const;
+	bool has_checksum() const;
+	const Entry& at(int index) const;
+	/**
+	 * @brief bytes
+	 * header and payload of frame (not more than rest of file)
+	 * @param index
+	 * @return
+	 */
+	qint64 bytes(int index) const;
+
+	static QString sidecar(const QString& fileName);
+	static quint32 adler32(const uchar* data, qint64 size, quint32 value = 1);
+
+private:
+	QString m_fileName;
+	qint64 m_file_size;
+	qint64 m_modified;		/// ms since epoch
+	bool m_checksum;
+	RawFormat m_format;
+	QVector< Entry > m_entries;
+
+	/// size and time of file are the same as in index
+	bool is_actual() const;
+};
+
+#endif // FRAMEINDEX_H
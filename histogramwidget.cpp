@@ -0,0 +1,108 @@
+#include "histogramwidget.h"
+
+#include <QPainter>
+#include <QPen>
+#include <QPolygonF>
+
+#include <math.h>
+
+/////////////////////////////////
+/// colors of channels and names in summary
+static const Qt::GlobalColor channel_colors[] = { Qt::red, Qt::green, Qt::blue };
+static const char* channel_names[] = { "R", "G", "B" };
+
+HistogramWidget::HistogramWidget(QWidget *parent)
+	: QWidget(parent)
+	, m_peak(0)
+	, m_range(0)
+	, m_white(0)
+{
+}
+
+void HistogramWidget::setStats(const RawStats &stats, int shift, int lshift)
+{
+	clear();
+	if(!stats.is_valid()){
+		update();
+		return;
+	}
+
+	m_range = 1ll << stats.bits;
+	m_white = ((qint64)255 << shift) >> lshift;
+
+	const int bins = (int)((m_range - 1) >> stats.bin_shift()) + 1;
+	for(int c = 0; c < RawStats::CHANNELS; ++c){
+		m_bins[c].resize(bins);
+		for(int i = 0; i < bins; ++i){
+			m_bins[c][i] = stats.channel_bin(c, i);
+			m_peak = qMax(m_peak, m_bins[c][i]);
+		}
+
+		m_summary << QString("%1  %2..%3  %4%: %5  clipped %6%")
+					 .arg(channel_names[c])
+					 .arg(stats.channel_min(c)).arg(stats.channel_max(c))
+					 .arg(RawStats::AUTO_FRACTION * 100).arg(stats.percentile(c, RawStats::AUTO_FRACTION))
+					 .arg(stats.clipped_percent(c), 0, 'f', 2);
+	}
+	update();
+}
+
+void HistogramWidget::clear()
+{
+	for(int c = 0; c < RawStats::CHANNELS; ++c){
+		m_bins[c].clear();
+	}
+	m_summary.clear();
+	m_peak = m_range = m_white = 0;
+	update();
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+
+	painter.fillRect(rect(), Qt::black);
+	if(!m_peak){
+		return;
+	}
+
+	const int line = fontMetrics().height();
+	const QRect plot = rect().adjusted(2, 2, -2, -2 - line * m_summary.size());
+	if(plot.width() < 2 || plot.height() < 2){
+		return;
+	}
+
+	/// counts by log scale: few clipped samples are seen near the peak of dark frame
+	const double top = log1p((double)m_peak);
+	const int bins = m_bins[0].size();
+
+	painter.setRenderHint(QPainter::Antialiasing);
+	for(int c = 0; c < RawStats::CHANNELS; ++c){
+		QPolygonF polyline;
+		/// maximum of bins under every column
+		for(int x = 0; x < plot.width(); ++x){
+			const int b0 = x * bins / plot.width();
+			const int b1 = qMax(b0 + 1, (x + 1) * bins / plot.width());
+			qint64 value = 0;
+			for(int b = b0; b < b1; ++b){
+				value = qMax(value, m_bins[c][b]);
+			}
+			polyline << QPointF(plot.left() + x, plot.bottom() - (plot.height() - 1) * log1p((double)value) / top);
+		}
+		painter.setPen(channel_colors[c]);
+		painter.drawPolyline(polyline);
+	}
+
+	/// samples over white point are saturated by tone curve
+	if(m_white < m_range){
+		const int x = plot.left() + (int)(plot.width() * m_white / m_range);
+		painter.setPen(QPen(Qt::white, 1, Qt::DashLine));
+		painter.drawLine(x, plot.top(), x, plot.bottom());
+	}
+
+	painter.setPen(Qt::lightGray);
+	for(int i = 0; i < m_summary.size(); ++i){
+		painter.drawText(QRect(plot.left(), plot.bottom() + 2 + i * line, plot.width(), line),
+						 Qt::AlignLeft | Qt::AlignVCenter, m_summary[i]);
+	}
+}
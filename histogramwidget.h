@@ -0,0 +1,47 @@
+#ifndef HISTOGRAMWIDGET_H
+#define HISTOGRAMWIDGET_H
+
+#include <QWidget>
+#include <QVector>
+#include <QStringList>
+
+#include "rawstats.h"
+
+///////////////////////////////////////////////
+/// \brief The HistogramWidget class
+/// histogram of raw samples by colors (log scale), white point of tone curve
+/// and summary of channels: min, max, percentile of auto shift and clipped samples
+///
+
+class HistogramWidget : public QWidget
+{
+	Q_OBJECT
+public:
+	explicit HistogramWidget(QWidget *parent = 0);
+
+	/**
+	 * @brief setStats
+	 * statistics of the shown frame
+	 * @param stats
+	 * @param shift - shift of tone curve (white point is 255 << shift)
+	 * @param lshift - left shift of samples
+	 */
+	void setStats(const RawStats& stats, int shift, int lshift);
+	void clear();
+
+	// QWidget interface
+protected:
+	virtual void paintEvent(QPaintEvent *);
+
+private:
+	/// bins of channels up to the depth of samples
+	QVector< qint64 > m_bins[RawStats::CHANNELS];
+	qint64 m_peak;
+	/// samples of depth are [0, m_range)
+	qint64 m_range;
+	/// white point of tone curve in samples
+	qint64 m_white;
+	QStringList m_summary;
+};
+
+#endif // HISTOGRAMWIDGET_H
@@ -2,6 +2,44 @@
 #include <QPainter>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <QRunnable>
+#include <QMetaObject>
+
+#include "pyramid.h"
+
+/////////////////////////////////
+/// \brief The PyramidTask class
+/// pyramid of image, result is sent to owner if image is still current
+
+class PyramidTask: public QRunnable{
+public:
+	PyramidTask(ImageOutput* owner, const QImage& image, int min_size, int generation, const QAtomicInt* current)
+		: m_owner(owner)
+		, m_image(image)
+		, m_min_size(min_size)
+		, m_generation(generation)
+		, m_current(current)
+	{
+	}
+	virtual void run(){
+		std::function< bool() > canceled = [this](){
+			return m_current->loadAcquire() != m_generation;
+		};
+		QVector< QImage > levels = pyramid::build(m_image, m_min_size, canceled);
+		if(!canceled())
+			QMetaObject::invokeMethod(m_owner, "setLevels", Qt::QueuedConnection,
+									  Q_ARG(int, m_generation), Q_ARG(QVector<QImage>, levels));
+	}
+
+private:
+	ImageOutput* m_owner;
+	QImage m_image;
+	int m_min_size;
+	int m_generation;
+	const QAtomicInt* m_current;
+};
+
+/////////////////////////////////
 
 ImageOutput::ImageOutput(QWidget *parent) :
 	QWidget(parent)
@@ -10,11 +48,45 @@ ImageOutput::ImageOutput(QWidget *parent) :
   , m_mouse_down(false)
   , m_scale_arg(1)
 {
+	qRegisterMetaType< QVector< QImage > >("QVector<QImage>");
+
+	setTileBudget(256);
+	m_pool.setMaxThreadCount(1);
 }
 
-void ImageOutput::setImage(const QImage &image)
+ImageOutput::~ImageOutput()
+{
+	/// builder holds pointer to this
+	m_generation.fetchAndAddOrdered(1);
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+void ImageOutput::setImage(const QImage &image, const QSize &frame)
 {
 	m_image = image;
+	m_frame = frame.isValid()? frame : image.size();
+	m_tiles.clear();
+	m_requested.clear();
+
+	/// previous pyramid is not valid, its building is stopped
+	m_levels.clear();
+	int generation = m_generation.fetchAndAddOrdered(1) + 1;
+	m_pool.clear();
+	if(!m_image.isNull()){
+		PyramidTask* task = new PyramidTask(this, m_image, MIN_LEVEL, generation, &m_generation);
+		task->setAutoDelete(true);
+		m_pool.start(task);
+	}
+
+	update();
+}
+
+void ImageOutput::setLevels(int generation, const QVector<QImage> &levels)
+{
+	if(generation != m_generation.loadAcquire())
+		return;
+	m_levels = levels;
 	update();
 }
 
@@ -24,6 +96,57 @@ void ImageOutput::setScaled(bool value)
 	update();
 }
 
+void ImageOutput::setTileBudget(int megabytes)
+{
+	m_tiles.setMaxCost(megabytes * 1024);
+}
+
+static inline quint64 tile_key(int row, int column)
+{
+	return ((quint64)row << 32) | (uint)column;
+}
+
+void ImageOutput::setTile(const QRect &rect, const QImage &image)
+{
+	m_tiles.insert(tile_key(rect.top() / TILE, rect.left() / TILE), new QImage(image),
+				   qMax(1, image.byteCount() / 1024));
+	update();
+}
+
+QRectF ImageOutput::viewRect() const
+{
+	return QRectF(m_image_pos, QSizeF(rect().width() / m_scale_arg, rect().height() / m_scale_arg));
+}
+
+void ImageOutput::drawTiles(QPainter &painter, const QRectF &view)
+{
+	const QRect frame(QPoint(), m_frame);
+	const QRect visible = view.toAlignedRect() & frame;
+
+	QVector< QRect > missing;
+	if(!visible.isEmpty()){
+		for(int row = visible.top() / TILE; row <= visible.bottom() / TILE; ++row){
+			for(int column = visible.left() / TILE; column <= visible.right() / TILE; ++column){
+				QRect rt = QRect(column * TILE, row * TILE, TILE, TILE) & frame;
+				QImage* tile = m_tiles.object(tile_key(row, column));
+				if(!tile){
+					missing << rt;
+					continue;
+				}
+				QRectF target((rt.left() - view.left()) * m_scale_arg, (rt.top() - view.top()) * m_scale_arg,
+							  rt.width() * m_scale_arg, rt.height() * m_scale_arg);
+				painter.drawImage(target, *tile);
+			}
+		}
+	}
+
+	/// request is sent only if view is changed, the new one replaces the previous
+	if(missing != m_requested){
+		m_requested = missing;
+		emit tilesNeeded(missing);
+	}
+}
+
 
 void ImageOutput::paintEvent(QPaintEvent *)
 {
@@ -34,7 +157,6 @@ void ImageOutput::paintEvent(QPaintEvent *)
 		return;
 	}
 
-	QImage tmp;
 	QRect rt = rect();
 
 	if(m_scaled){
@@ -43,38 +165,31 @@ void ImageOutput::paintEvent(QPaintEvent *)
 				ar_wnd = 1.0 * rt.width()/rt.height();
 
 		/// задание режима сглаживания
-		Qt::TransformationMode tm = m_is_smooth? Qt::SmoothTransformation : Qt::FastTransformation;
+		painter.setRenderHint(QPainter::SmoothPixmapTransform, m_is_smooth);
 
+		QSize size;
 		if(ar_wnd > ar){
-			tmp = m_image.scaled(rt.height() * ar, rt.height(), Qt::IgnoreAspectRatio, tm);
+			size = QSize(rt.height() * ar, rt.height());
 		}else{
-			tmp = m_image.scaled(rt.width(), rt.width()/ar, Qt::IgnoreAspectRatio, tm);
+			size = QSize(rt.width(), rt.width()/ar);
 		}
-		//m_mutex.unlock();
-
-		painter.drawImage(QPoint(rt.width()/2 - tmp.width()/2, rt.height()/2 - tmp.height()/2), tmp);
-	}else{
-		QPointF pt = m_image_pos;
-		int w = m_image.width() * m_scale_arg, h = m_image.height() * m_scale_arg;
 
-		double ar = (double)m_image.height() / m_image.width();
-		double ar_wnd = (double)rect().height() / rect().width();
+		/// the nearest level of pyramid not less than window (image itself until pyramid is built)
+		const QImage& level = pyramid::nearest(m_image, m_levels, size);
 
-		if(ar < ar_wnd){
-			w = (double)rect().width() / m_scale_arg;
-			h = (double)rect().width() / m_scale_arg * ar_wnd;
-		}else{
-			w = (double)rect().width() / m_scale_arg;
-			h = (double)rect().width() / m_scale_arg * ar_wnd;
-		}
-
-		QRectF rt1(pt, QSize(w, h));
-		//pt *= m_scale_arg;
+		QRect target(QPoint(rt.width()/2 - size.width()/2, rt.height()/2 - size.height()/2), size);
+		painter.drawImage(target, level);
+	}else{
+		/// only visible part is scaled; image may be overview of smaller size than frame
+		QRectF view = viewRect();
+		double k = (double)m_image.width() / m_frame.width();
+		QRectF source(view.left() * k, view.top() * k, view.width() * k, view.height() * k);
 
-		tmp = m_image.copy(rt1.toRect());
-		tmp = tmp.scaled(w * m_scale_arg, h * m_scale_arg);
+		painter.drawImage(QRectF(rt), m_image, source);
 
-		painter.drawImage(QPoint(), tmp);
+		/// full resolution of visible part comes by tiles
+		if(m_image.size() != m_frame)
+			drawTiles(painter, view);
 	}
 }
 
@@ -104,10 +219,10 @@ void ImageOutput::mouseMoveEvent(QMouseEvent *e)
 				m_image_pos.setX(0);
 			if(m_image_pos.y() < 0)
 				m_image_pos.setY(0);
-			if(m_image_pos.x() > m_image.width() - rect().width())
-				m_image_pos.setX(m_image.width() - rect().width());
-			if(m_image_pos.y() > m_image.height() - rect().height())
-				m_image_pos.setY(m_image.height() - rect().height());
+			if(m_image_pos.x() > m_frame.width() - rect().width())
+				m_image_pos.setX(m_frame.width() - rect().width());
+			if(m_image_pos.y() > m_frame.height() - rect().height())
+				m_image_pos.setY(m_frame.height() - rect().height());
 		}
 		update();
 	}
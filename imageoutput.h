@@ -2,19 +2,53 @@
 #define IMAGEOUTPUT_H
 
 #include <QWidget>
+#include <QCache>
+#include <QVector>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+class QPainter;
 
 class ImageOutput : public QWidget
 {
 	Q_OBJECT
 public:
 	explicit ImageOutput(QWidget *parent = 0);
+	~ImageOutput();
 
-	void setImage(const QImage& image);
+	/**
+	 * @brief setImage
+	 * new frame: cache of tiles is cleared, pyramid is built in background
+	 * @param image - whole frame or overview of smaller size
+	 * @param frame - size of frame (size of image if not set)
+	 */
+	void setImage(const QImage& image, const QSize& frame = QSize());
 	void setScaled(bool value);
+	/**
+	 * @brief setTileBudget
+	 * memory of tile cache, least recently used tiles are removed
+	 * @param megabytes
+	 */
+	void setTileBudget(int megabytes);
 
 signals:
+	/**
+	 * @brief tilesNeeded
+	 * visible tiles which are not in cache (coordinates of frame).
+	 * used in zoom mode when image is smaller than frame
+	 * @param rects
+	 */
+	void tilesNeeded(const QVector< QRect >& rects);
 
 public slots:
+	void setTile(const QRect& rect, const QImage& image);
+
+private slots:
+	/**
+	 * @brief setLevels
+	 * pyramid of image of generation
+	 */
+	void setLevels(int generation, const QVector< QImage >& levels);
 
 
 	// QWidget interface
@@ -22,7 +56,30 @@ protected:
 	virtual void paintEvent(QPaintEvent *);
 
 private:
+	/// side of tile, even so tiles begin on bayer quad
+	enum{
+		TILE = 256
+	};
+
+	/// the smallest level of pyramid
+	enum{
+		MIN_LEVEL = 64
+	};
+
 	QImage m_image;
+	QSize m_frame;
+
+	/// levels of m_image for scaled mode, empty until built
+	QVector< QImage > m_levels;
+	/// number of m_image, pyramids of previous images are dropped
+	QAtomicInt m_generation;
+	/// builder of pyramid (one thread, rows of levels go to global pool)
+	QThreadPool m_pool;
+
+	/// tiles by index (row << 32 | column), cost in KB
+	QCache< quint64, QImage > m_tiles;
+	/// last emitted tilesNeeded()
+	QVector< QRect > m_requested;
 
 	bool m_is_smooth;
 	bool m_scaled;
@@ -33,6 +90,10 @@ private:
 	QPointF m_image_pos;
 	double m_scale_arg;
 
+	/// visible part of frame in zoom mode
+	QRectF viewRect() const;
+	void drawTiles(QPainter& painter, const QRectF& view);
+
 	// QWidget interface
 protected:
 	virtual void mousePressEvent(QMouseEvent *);
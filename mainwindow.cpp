@@ -9,9 +9,21 @@
 #include <QDomNodeList>
 
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegExp>
 
 const QString window_title = "RawReader";
 
+/// files which are opened by raw_reader
+const QStringList folder_filters = QStringList() << "*.raw" << "*.bin" << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp";
+
+/// files of folder decoded ahead: after and before current one (if they fit into cache)
+enum{
+	PREFETCH_AHEAD = 8,
+	PREFETCH_BEHIND = 2
+};
+
 //////////////////////////////////////////////
 /// \brief MainWindow::MainWindow
 /// \param parent
@@ -30,9 +42,24 @@ MainWindow::MainWindow(QWidget *parent) :
 
 	connect(&m_rawReader->reader(), SIGNAL(log_message(RawReader::STATE_TYPE,QString)),
 			this, SLOT(onLogMessage(RawReader::STATE_TYPE,QString)), Qt::QueuedConnection);
-
-	ui->spinBox->setValue(m_rawReader->reader().shift());
-	ui->sb_lshift->setValue(m_rawReader->reader().lshift());
+	connect(m_rawReader, SIGNAL(frame_ready(QImage,FrameInfo)), this, SLOT(onFrameReady(QImage,FrameInfo)), Qt::QueuedConnection);
+	connect(m_rawReader, SIGNAL(stats_ready(RawStats,int)), this, SLOT(onStatsReady(RawStats,int)), Qt::QueuedConnection);
+	/// zoom mode: visible tiles are computed by worker between jobs
+	connect(ui->widget, SIGNAL(tilesNeeded(QVector<QRect>)), m_rawReader, SLOT(request_tiles(QVector<QRect>)));
+	connect(m_rawReader, SIGNAL(tile_ready(QRect,QImage)), ui->widget, SLOT(setTile(QRect,QImage)), Qt::QueuedConnection);
+
+	m_player = new SequencePlayer(this);
+	m_player->set_fps(ui->dsb_fps->value());
+	connect(m_player, SIGNAL(frame_ready(int,QImage)), this, SLOT(onSequenceFrame(int,QImage)));
+	connect(m_player, SIGNAL(opened(int)), this, SLOT(onSequenceOpened(int)));
+
+	RawReader::Settings settings = m_rawReader->settings();
+	ui->spinBox->setValue(settings.shift);
+	ui->chb_auto_shift->setChecked(settings.auto_shift);
+	ui->sb_lshift->setValue(settings.lshift);
+	ui->sb_threads->setValue(settings.threads);
+	ui->cb_pattern->setCurrentIndex(settings.pattern);
+	m_rawReader->set_cache_budget(ui->sb_cache->value());
 
 	connect(&m_timer, SIGNAL(timeout()), this, SLOT(on_timeout()));
 	m_timer.setInterval(300);
@@ -41,6 +68,9 @@ MainWindow::MainWindow(QWidget *parent) :
 	m_statusLabel->setMinimumWidth(200);
 	ui->statusBar->addWidget(m_statusLabel);
 
+	m_traceLabel = new QLabel(this);
+	ui->statusBar->addPermanentWidget(m_traceLabel);
+
 	loadXml();
 }
 
@@ -48,6 +78,7 @@ MainWindow::~MainWindow()
 {
 	saveXml();
 
+	delete m_player;
 	delete m_rawReader;
 
 	delete ui;
@@ -62,55 +93,114 @@ void MainWindow::on_actionOpen_triggered()
 	}
 }
 
+void MainWindow::on_actionNext_triggered()
+{
+	navigate(1);
+}
+
+void MainWindow::on_actionPrevious_triggered()
+{
+	navigate(-1);
+}
+
 void MainWindow::on_sb_width_valueChanged(const QString &arg1)
 {
 }
 
 void MainWindow::on_sb_width_valueChanged(int arg1)
 {
-	m_rawReader->reader().set_size(arg1, ui->sb_height->value());
+	/// size is used on next reading of file
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.width = arg1;
+	m_rawReader->set_settings(settings);
 }
 
 void MainWindow::on_spinBox_valueChanged(int arg1)
 {
-	m_rawReader->reader().set_shift(arg1);
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.shift = arg1;
+	m_rawReader->set_settings(settings);
+	start_work();
+}
+
+void MainWindow::on_chb_auto_shift_clicked(bool checked)
+{
+	/// manual shift continues from the shown value
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.auto_shift = checked;
+	settings.shift = ui->spinBox->value();
+	m_rawReader->set_settings(settings);
+	ui->spinBox->setEnabled(!checked);
 	start_work();
 }
 
 void MainWindow::on_timeout()
 {
+	/// stages are shown while job is running; frames come by frame_ready()
+	if(m_rawReader)
+		m_traceLabel->setText(m_rawReader->reader().trace().summary());
+
 	if(m_rawReader && m_rawReader->is_made()){
 		m_timer.stop();
 
-		ui->sb_width->setValue(m_rawReader->reader().width());
-		ui->sb_height->setValue(m_rawReader->reader().height());
-		ui->widget->setImage(m_rawReader->reader().image());
+		/// size and times come with frame, reader is used by thread of worker
+		if(!m_frameInfo.size.isEmpty()){
+			ui->sb_width->setValue(m_frameInfo.size.width());
+			ui->sb_height->setValue(m_frameInfo.size.height());
+		}
 		ui->lb_work->setVisible(false);
 
-		ui->lb_time_exec->setText(QString("time execute: %1 ms").arg(m_rawReader->time_exec()));
+		QString threads;
+		const QVector< double >& times = m_frameInfo.thread_times;
+		for(int i = 0; i < times.size(); ++i){
+			threads += QString("\n  thread %1: %2 ms").arg(i).arg(times[i], 0, 'f', 1);
+		}
+
+		ui->lb_time_exec->setText(QString("time load: %1 ms\ntime execute: %2 ms (%3 ms/MP)%4")
+								  .arg(m_frameInfo.time_load)
+								  .arg(m_frameInfo.time_exec)
+								  .arg(m_frameInfo.time_per_mp, 0, 'f', 1)
+								  .arg(m_frameInfo.cached? "\nfrom cache" : "") + threads);
 	}
 }
 
 void MainWindow::on_chbscaled_clicked(bool checked)
 {
 	ui->widget->setScaled(checked);
+	/// in zoom mode whole frame is not needed, only overview and visible tiles
+	m_rawReader->set_tiled(!checked);
+	start_work();
 }
 
 void MainWindow::on_cb_demoscale_currentIndexChanged(int index)
 {
+	RawReader::Settings settings = m_rawReader->settings();
 	switch (index) {
 		case 0:
-			m_rawReader->reader().set_demoscaling(RawReader::GRAY);
+			settings.demoscaling = RawReader::GRAY;
 			break;
 		case 1:
-			m_rawReader->reader().set_demoscaling(RawReader::SIMPLE);
+			settings.demoscaling = RawReader::SIMPLE;
 			break;
 		case 2:
-			m_rawReader->reader().set_demoscaling(RawReader::LINEAR);
+			settings.demoscaling = RawReader::LINEAR;
+			break;
+		case 3:
+			settings.demoscaling = RawReader::MALVAR;
+			break;
+		case 4:
+			settings.demoscaling = RawReader::VNG;
+			break;
+		case 5:
+			settings.demoscaling = RawReader::AHD;
+			break;
+		case 6:
+			settings.demoscaling = RawReader::HALF;
 			break;
 		default:
 			break;
 	}
+	m_rawReader->set_settings(settings);
 	start_work();
 }
 
@@ -140,17 +230,65 @@ void MainWindow::loadXml()
 	QByteArray data = file.readAll();
 	dom.setContent(data);
 
-	QString value = get_from_xml(dom, "filename");
-	if(!value.isNull())
-		open_file(value);
+	/// before file, so the first job is traced too
+	bool trace = get_from_xml(dom, "trace").toInt();
+	ui->chb_trace->setChecked(trace);
+	on_chb_trace_clicked(trace);
+
+	bool progressive = get_from_xml(dom, "progressive").toInt();
+	ui->chb_progressive->setChecked(progressive);
+	on_chb_progressive_clicked(progressive);
+
+	/// the first job is started by file
+	bool auto_shift = get_from_xml(dom, "auto_shift").toInt();
+	ui->chb_auto_shift->setChecked(auto_shift);
+	ui->spinBox->setEnabled(!auto_shift);
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.auto_shift = auto_shift;
+	m_rawReader->set_settings(settings);
+
 	ui->sb_width->setValue(get_from_xml(dom, "width").toInt());
 	ui->sb_height->setValue(get_from_xml(dom, "height").toInt());
 
+	int threads = get_from_xml(dom, "threads").toInt();
+	if(threads > 0)
+		ui->sb_threads->setValue(threads);
+
+	int cache = get_from_xml(dom, "cache").toInt();
+	if(cache > 0)
+		ui->sb_cache->setValue(cache);
+
+	QString pattern = get_from_xml(dom, "pattern");
+	if(!pattern.isEmpty())
+		ui->cb_pattern->setCurrentIndex(pattern.toInt());
+
+	int format = ui->cb_raw_format->findText(get_from_xml(dom, "raw_format"));
+	if(format >= 0)
+		ui->cb_raw_format->setCurrentIndex(format);
+	ui->sb_header->setValue(get_from_xml(dom, "header").toInt());
+	ui->sb_stride->setValue(get_from_xml(dom, "stride").toInt());
+
+	QString black = get_from_xml(dom, "black");
+	if(!black.isEmpty())
+		ui->le_black->setText(black);
+	QString wb = get_from_xml(dom, "wb");
+	if(!wb.isEmpty())
+		ui->le_wb->setText(wb);
+	QString matrix = get_from_xml(dom, "matrix");
+	if(!matrix.isEmpty())
+		ui->le_matrix->setText(matrix);
+	apply_color();
+
 	int val = get_from_xml(dom, "type").toInt();
 	if(val == 1)
 		ui->rb_type1->setChecked(true);
 	else
 		ui->rb_type2->setChecked(true);
+
+	/// file is read with the loaded parameters
+	QString value = get_from_xml(dom, "filename");
+	if(!value.isNull())
+		open_file(value);
 }
 
 void create_text_node(QDomDocument& dom, QDomNode& tree, const QString& name, const QString& value)
@@ -181,6 +319,18 @@ void MainWindow::saveXml()
 	create_text_node(dom, tree, "width", ui->sb_width->value());
 	create_text_node(dom, tree, "height", ui->sb_height->value());
 	create_text_node(dom, tree, "type", ui->rb_type1->isChecked()? "1" : "2");
+	create_text_node(dom, tree, "raw_format", ui->cb_raw_format->currentText());
+	create_text_node(dom, tree, "header", ui->sb_header->value());
+	create_text_node(dom, tree, "stride", ui->sb_stride->value());
+	create_text_node(dom, tree, "black", ui->le_black->text());
+	create_text_node(dom, tree, "wb", ui->le_wb->text());
+	create_text_node(dom, tree, "matrix", ui->le_matrix->text());
+	create_text_node(dom, tree, "auto_shift", ui->chb_auto_shift->isChecked()? 1 : 0);
+	create_text_node(dom, tree, "threads", ui->sb_threads->value());
+	create_text_node(dom, tree, "cache", ui->sb_cache->value());
+	create_text_node(dom, tree, "pattern", ui->cb_pattern->currentIndex());
+	create_text_node(dom, tree, "trace", ui->chb_trace->isChecked()? 1 : 0);
+	create_text_node(dom, tree, "progressive", ui->chb_progressive->isChecked()? 1 : 0);
 
 	QByteArray data = dom.toByteArray();
 	QFile file(xml_config);
@@ -192,13 +342,30 @@ void MainWindow::saveXml()
 
 void MainWindow::start_work()
 {
+	/// during playback frames with new parameters come from player
+	if(m_player->is_playing()){
+		m_player->set_settings(m_rawReader->settings());
+		return;
+	}
 	m_rawReader->start_compute();
 	m_timer.start();
 	ui->lb_work->setVisible(true);
 }
 
-void MainWindow::open_file(const QString &fileName)
+void MainWindow::open_file(const QString &name)
 {
+	/// the same name of file in folder and in cache
+	const QString fileName = QFileInfo(name).absoluteFilePath();
+
+	/// new file begins from the first frame
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.frame = 0;
+	m_rawReader->set_settings(settings);
+
+	/// neighbours are decoded ahead after the file
+	update_folder(fileName);
+	m_rawReader->set_prefetch(neighbours(m_folder.indexOf(fileName)));
+
 	if(m_rawReader->start_read_file(fileName)){
 		m_fileName = fileName;
 
@@ -206,13 +373,91 @@ void MainWindow::open_file(const QString &fileName)
 
 		m_timer.start();
 		ui->lb_work->setVisible(true);
+
+		open_sequence();
+	}
+}
+
+void MainWindow::navigate(int step)
+{
+	if(m_fileName.isEmpty())
+		return;
+
+	update_folder(m_fileName);
+	const int index = m_folder.indexOf(m_fileName) + step;
+	if(index < 0 || index >= m_folder.size())
+		return;
+
+	open_file(m_folder[index]);
+}
+
+void MainWindow::update_folder(const QString &fileName)
+{
+	/// new files of folder are seen after opening of file out of list
+	if(m_folder.contains(fileName))
+		return;
+
+	QDir dir = QFileInfo(fileName).absoluteDir();
+	m_folder.clear();
+	foreach(const QString& name, dir.entryList(folder_filters, QDir::Files, QDir::Name | QDir::IgnoreCase)){
+		m_folder << dir.absoluteFilePath(name);
+	}
+}
+
+QStringList MainWindow::neighbours(int index) const
+{
+	QStringList res;
+	if(index < 0)
+		return res;
+
+	/// stepping forward is more likely, a few files behind are kept for going back
+	for(int d = 1; d <= PREFETCH_AHEAD; ++d){
+		if(index + d < m_folder.size())
+			res << m_folder[index + d];
+		if(d <= PREFETCH_BEHIND && index - d >= 0)
+			res << m_folder[index - d];
 	}
+	return res;
+}
+
+void MainWindow::open_sequence()
+{
+	ui->pb_play->setChecked(false);
+	/// controls of frames are disabled until frames are known
+	ui->hs_frame->setEnabled(false);
+	ui->pb_play->setEnabled(false);
+
+	/// index of stream is built in background, see onSequenceOpened()
+	m_player->open(m_fileName, m_rawReader->settings());
+}
+
+void MainWindow::onSequenceOpened(int count)
+{
+	RawReader::Settings settings = m_rawReader->settings();
+	/// frame of worker is kept in the file; frame out of file is computed again
+	const bool moved = settings.frame != m_player->position();
+	settings.frame = m_player->position();
+	m_rawReader->set_settings(settings);
+	if(moved)
+		start_work();
+
+	ui->hs_frame->blockSignals(true);
+	ui->hs_frame->setRange(0, qMax(0, count - 1));
+	ui->hs_frame->setValue(m_player->position());
+	ui->hs_frame->blockSignals(false);
+
+	ui->hs_frame->setEnabled(count > 1);
+	ui->pb_play->setEnabled(count > 1);
+	ui->pb_play->setText("play");
+	ui->lb_frame->setText(count > 1? QString("%1 / %2").arg(m_player->position() + 1).arg(count) : "");
 }
 
 void MainWindow::on_sb_lshift_valueChanged(int arg1)
 {
 	if(m_rawReader){
-		m_rawReader->reader().set_lshift(arg1);
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.lshift = arg1;
+		m_rawReader->set_settings(settings);
 		start_work();
 	}
 }
@@ -220,7 +465,10 @@ void MainWindow::on_sb_lshift_valueChanged(int arg1)
 void MainWindow::on_rb_type1_clicked(bool checked)
 {
 	if(checked){
-		m_rawReader->reader().set_type(RawReader::RAW_TYPE_1);
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.type = RawReader::RAW_TYPE_1;
+		m_rawReader->set_settings(settings);
+		open_sequence();
 		start_work();
 	}
 }
@@ -228,19 +476,62 @@ void MainWindow::on_rb_type1_clicked(bool checked)
 void MainWindow::on_rb_type2_clicked(bool checked)
 {
 	if(checked){
-		m_rawReader->reader().set_type(RawReader::RAW_TYPE_2);
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.type = RawReader::RAW_TYPE_2;
+		m_rawReader->set_settings(settings);
+		open_sequence();
 		start_work();
 	}
 }
 
+void MainWindow::on_cb_raw_format_currentIndexChanged(int index)
+{
+	if(m_rawReader && index >= 0){
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.format = raw_format();
+		m_rawReader->set_settings(settings);
+		open_sequence();
+		start_work();
+	}
+}
+
+void MainWindow::on_sb_header_valueChanged(int arg1)
+{
+	Q_UNUSED(arg1);
+	/// applied by "recompute" as size of frame
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.format = raw_format();
+	m_rawReader->set_settings(settings);
+}
+
+void MainWindow::on_sb_stride_valueChanged(int arg1)
+{
+	Q_UNUSED(arg1);
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.format = raw_format();
+	m_rawReader->set_settings(settings);
+}
+
+RawFormat MainWindow::raw_format() const
+{
+	RawFormat res = RawFormat::from_name(ui->cb_raw_format->currentText());
+	res.header = ui->sb_header->value();
+	res.stride = ui->sb_stride->value();
+	return res;
+}
+
 void MainWindow::on_pb_recompute_clicked()
 {
+	/// size of frame may be changed, so number of frames too
+	open_sequence();
 	start_work();
 }
 
 void MainWindow::on_sb_height_valueChanged(int arg1)
 {
-	m_rawReader->reader().set_size(ui->sb_width->value(), arg1);
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.height = arg1;
+	m_rawReader->set_settings(settings);
 }
 
 void MainWindow::onLogMessage(RawReader::STATE_TYPE type, const QString &text)
@@ -260,3 +551,204 @@ void MainWindow::onLogMessage(RawReader::STATE_TYPE type, const QString &text)
 			break;
 	}
 }
+
+void MainWindow::onFrameReady(const QImage &image, const FrameInfo &info)
+{
+	/// image is shared with front buffer of worker, it is released on the next frame
+	ui->widget->setImage(image, info.size);
+	m_frameInfo = info;
+
+	/// statistics without waiting for the timer
+	if(m_rawReader->is_made())
+		on_timeout();
+}
+
+void MainWindow::onStatsReady(const RawStats &stats, int shift)
+{
+	ui->histogram->setStats(stats, shift, ui->sb_lshift->value());
+
+	/// selected shift is shown, it is not a new job
+	if(ui->chb_auto_shift->isChecked()){
+		ui->spinBox->blockSignals(true);
+		ui->spinBox->setValue(shift);
+		ui->spinBox->blockSignals(false);
+	}
+}
+
+void MainWindow::on_sb_threads_valueChanged(int arg1)
+{
+	if(m_rawReader){
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.threads = arg1;
+		m_rawReader->set_settings(settings);
+		start_work();
+	}
+}
+
+void MainWindow::on_sb_cache_valueChanged(int arg1)
+{
+	if(m_rawReader)
+		m_rawReader->set_cache_budget(arg1);
+}
+
+void MainWindow::on_cb_curve_currentIndexChanged(int index)
+{
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.curve = static_cast< ToneCurve::TYPE >(index);
+
+	switch (index) {
+		case ToneCurve::CURVE_GAMMA:
+			settings.gamma = ui->dsb_curve_param->value();
+			break;
+		case ToneCurve::CURVE_LOG:
+			settings.log_scale = ui->dsb_curve_param->value();
+			break;
+		case ToneCurve::CURVE_POINTS:
+			m_rawReader->set_settings(settings);
+			on_le_curve_points_editingFinished();
+			return;
+		default:
+			break;
+	}
+	m_rawReader->set_settings(settings);
+	start_work();
+}
+
+void MainWindow::on_dsb_curve_param_valueChanged(double arg1)
+{
+	RawReader::Settings settings = m_rawReader->settings();
+
+	switch (settings.curve) {
+		case ToneCurve::CURVE_GAMMA:
+			settings.gamma = arg1;
+			break;
+		case ToneCurve::CURVE_LOG:
+			settings.log_scale = arg1;
+			break;
+		default:
+			return;
+	}
+	m_rawReader->set_settings(settings);
+	start_work();
+}
+
+void MainWindow::on_le_curve_points_editingFinished()
+{
+	/// "x:y x:y ..."
+	QVector< QPointF > points;
+	QStringList list = ui->le_curve_points->text().split(QRegExp("[\\s;]+"), QString::SkipEmptyParts);
+	foreach (const QString& item, list) {
+		QStringList xy = item.split(":");
+		if(xy.size() == 2){
+			points << QPointF(xy[0].toDouble(), xy[1].toDouble());
+		}
+	}
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.points = points;
+	m_rawReader->set_settings(settings);
+
+	if(settings.curve == ToneCurve::CURVE_POINTS)
+		start_work();
+}
+
+void MainWindow::on_le_black_editingFinished()
+{
+	apply_color();
+	start_work();
+}
+
+void MainWindow::on_le_wb_editingFinished()
+{
+	apply_color();
+	start_work();
+}
+
+void MainWindow::on_le_matrix_editingFinished()
+{
+	apply_color();
+	start_work();
+}
+
+ColorCorrection MainWindow::color() const
+{
+	ColorCorrection res;
+	ColorCorrection::parse(ui->le_black->text(), res.black, 3);
+	ColorCorrection::parse(ui->le_wb->text(), res.gains, 3);
+	ColorCorrection::parse(ui->le_matrix->text(), res.matrix, 9);
+	return res;
+}
+
+void MainWindow::apply_color()
+{
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.color = color();
+	m_rawReader->set_settings(settings);
+}
+
+void MainWindow::on_cb_pattern_currentIndexChanged(int index)
+{
+	if(m_rawReader && index >= 0){
+		RawReader::Settings settings = m_rawReader->settings();
+		settings.pattern = static_cast< cfa::PATTERN >(index);
+		m_rawReader->set_settings(settings);
+		start_work();
+	}
+}
+
+void MainWindow::on_chb_trace_clicked(bool checked)
+{
+	m_rawReader->set_trace_dir(checked? "traces" : "");
+}
+
+void MainWindow::on_chb_progressive_clicked(bool checked)
+{
+	m_rawReader->set_progressive(checked);
+}
+
+void MainWindow::on_hs_frame_valueChanged(int value)
+{
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.frame = value;
+	m_rawReader->set_settings(settings);
+
+	ui->lb_frame->setText(QString("%1 / %2").arg(value + 1).arg(m_player->frame_count()));
+
+	if(m_player->is_playing())
+		m_player->seek(value);
+	else
+		start_work();
+}
+
+void MainWindow::on_pb_play_clicked(bool checked)
+{
+	if(checked){
+		m_player->set_settings(m_rawReader->settings());
+		m_player->seek(ui->hs_frame->value());
+		m_player->play();
+	}else{
+		m_player->pause();
+	}
+	ui->pb_play->setText(checked? "pause" : "play");
+}
+
+void MainWindow::on_dsb_fps_valueChanged(double arg1)
+{
+	m_player->set_fps(arg1);
+}
+
+void MainWindow::onSequenceFrame(int index, const QImage &image)
+{
+	ui->widget->setImage(image);
+
+	/// frame of worker follows playback, so parameters after pause are applied to the shown frame
+	RawReader::Settings settings = m_rawReader->settings();
+	settings.frame = index;
+	m_rawReader->set_settings(settings);
+
+	ui->hs_frame->blockSignals(true);
+	ui->hs_frame->setValue(index);
+	ui->hs_frame->blockSignals(false);
+
+	ui->lb_frame->setText(QString("%1 / %2, late %3").arg(index + 1).arg(m_player->frame_count())
+						  .arg(m_player->late_frames()));
+}
@@ -4,8 +4,10 @@
 #include <QMainWindow>
 #include <QByteArray>
 #include <QTimer>
+#include <QStringList>
 
 #include "rawreader.h"
+#include "sequenceplayer.h"
 
 class QLabel;
 
@@ -24,12 +26,18 @@ public:
 private slots:
 	void on_actionOpen_triggered();
 
+	void on_actionNext_triggered();
+
+	void on_actionPrevious_triggered();
+
 	void on_sb_width_valueChanged(const QString &arg1);
 
 	void on_sb_width_valueChanged(int arg1);
 
 	void on_spinBox_valueChanged(int arg1);
 
+	void on_chb_auto_shift_clicked(bool checked);
+
 	void on_timeout();
 
 	void on_chbscaled_clicked(bool checked);
@@ -42,27 +50,97 @@ private slots:
 
 	void on_rb_type2_clicked(bool checked);
 
+	void on_cb_raw_format_currentIndexChanged(int index);
+
+	void on_sb_header_valueChanged(int arg1);
+
+	void on_sb_stride_valueChanged(int arg1);
+
 	void on_pb_recompute_clicked();
 
 	void on_sb_height_valueChanged(int arg1);
 
+	void on_sb_threads_valueChanged(int arg1);
+
+	void on_sb_cache_valueChanged(int arg1);
+
+	void on_cb_curve_currentIndexChanged(int index);
+
+	void on_dsb_curve_param_valueChanged(double arg1);
+
+	void on_le_curve_points_editingFinished();
+
+	void on_le_black_editingFinished();
+
+	void on_le_wb_editingFinished();
+
+	void on_le_matrix_editingFinished();
+
+	void on_cb_pattern_currentIndexChanged(int index);
+
+	void on_chb_trace_clicked(bool checked);
+
+	void on_chb_progressive_clicked(bool checked);
+
 	void onLogMessage(RawReader::STATE_TYPE type, const QString& text);
 
+	void onFrameReady(const QImage& image, const FrameInfo& info);
+
+	void onStatsReady(const RawStats& stats, int shift);
+
+	void on_hs_frame_valueChanged(int value);
+
+	void on_pb_play_clicked(bool checked);
+
+	void on_dsb_fps_valueChanged(double arg1);
+
+	void onSequenceFrame(int index, const QImage& image);
+
+	void onSequenceOpened(int count);
+
 private:
 	Ui::MainWindow *ui;
 	QTimer m_timer;
 	QString m_fileName;
+	/// size and times of the last frame of worker
+	FrameInfo m_frameInfo;
+	/// files of folder of current file (raw and images by name)
+	QStringList m_folder;
 
 	QLabel* m_statusLabel;
+	/// time of stages of current job
+	QLabel* m_traceLabel;
 
 	RawReaderWorker* m_rawReader;
+	/// playback of file with many frames (type 2)
+	SequencePlayer* m_player;
 
 	void loadXml();
 	void saveXml();
 
 	void start_work();
-
-	void open_file(const QString& fileName);
+	/// format of samples from controls
+	RawFormat raw_format() const;
+	/// black level, white balance and matrix from controls (wrong text is default)
+	ColorCorrection color() const;
+	void apply_color();
+
+	void open_file(const QString& name);
+	/**
+	 * @brief navigate
+	 * file of folder by step from current one
+	 * @param step
+	 */
+	void navigate(int step);
+	/// folder of file is listed if file is not in list of current folder
+	void update_folder(const QString& fileName);
+	/// files to decode ahead around file of folder, the nearest first
+	QStringList neighbours(int index) const;
+	/**
+	 * @brief open_sequence
+	 * frames of current file with current size, controls of playback are enabled for more than one frame
+	 */
+	void open_sequence();
 };
 
 #endif // MAINWINDOW_H
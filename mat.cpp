@@ -0,0 +1,98 @@
+#include "mat.h"
+
+#include <QMutexLocker>
+
+BufferPool::BufferPool()
+	: m_free_bytes(0)
+	, m_limit((size_t)512 << 20)
+	, m_allocations(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+	clear();
+}
+
+BufferPool &BufferPool::instance()
+{
+	/// not deleted: images and matrices of static objects may be released after exit()
+	static BufferPool* pool = new BufferPool;
+	return *pool;
+}
+
+void *BufferPool::acquire(size_t bytes)
+{
+	{
+		QMutexLocker lock(&m_mutex);
+		for(int i = 0; i < m_free.size(); ++i){
+			if(m_free[i].bytes == bytes){
+				void* ptr = m_free[i].ptr;
+				m_free.removeAt(i);
+				m_free_bytes -= bytes;
+				return ptr;
+			}
+		}
+	}
+
+	/// size may come from header of file: caller reports error of file, process goes on
+	void* ptr = qMallocAligned(bytes, ALIGNMENT);
+	if(!ptr)
+		return 0;
+
+	QMutexLocker lock(&m_mutex);
+	m_sizes.insert(ptr, bytes);
+	m_allocations++;
+	return ptr;
+}
+
+void BufferPool::release(void *ptr)
+{
+	if(!ptr)
+		return;
+
+	QMutexLocker lock(&m_mutex);
+	Block block;
+	block.ptr = ptr;
+	block.bytes = m_sizes.value(ptr);
+	m_free.push_back(block);
+	m_free_bytes += block.bytes;
+	trim();
+}
+
+void BufferPool::set_limit(int megabytes)
+{
+	QMutexLocker lock(&m_mutex);
+	m_limit = (size_t)qMax(0, megabytes) << 20;
+	trim();
+}
+
+void BufferPool::clear()
+{
+	QMutexLocker lock(&m_mutex);
+	size_t limit = m_limit;
+	m_limit = 0;
+	trim();
+	m_limit = limit;
+}
+
+qint64 BufferPool::allocations() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_allocations;
+}
+
+void BufferPool::release_image(void *ptr)
+{
+	instance().release(ptr);
+}
+
+void BufferPool::trim()
+{
+	while(m_free_bytes > m_limit && !m_free.isEmpty()){
+		Block block = m_free.takeFirst();
+		m_free_bytes -= block.bytes;
+		m_sizes.remove(block.ptr);
+		qFreeAligned(block.ptr);
+	}
+}
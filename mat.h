@@ -0,0 +1,277 @@
+#ifndef MAT_H
+#define MAT_H
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+
+#include <string.h>
+#include <algorithm>
+
+///////////////////////////////////////////////
+/// \brief The BufferPool class
+/// aligned blocks of memory of process: released block is kept for the next request of the same size,
+/// so frames of the same size are decoded without allocations
+///
+
+class BufferPool
+{
+public:
+	enum{
+		ALIGNMENT = 64
+	};
+
+	static BufferPool& instance();
+	/**
+	 * @brief acquire
+	 * free block of the size or new one
+	 * @param bytes
+	 * @return aligned to ALIGNMENT, 0 if there is no memory
+	 */
+	void* acquire(size_t bytes);
+	/**
+	 * @brief release
+	 * block of acquire() goes to free ones; the oldest free blocks are deleted over limit
+	 * @param ptr
+	 */
+	void release(void* ptr);
+	/**
+	 * @brief set_limit
+	 * memory of free blocks
+	 * @param megabytes
+	 */
+	void set_limit(int megabytes);
+	/// free blocks are deleted
+	void clear();
+	/**
+	 * @brief allocations
+	 * number of blocks allocated from system (not from pool) since start
+	 * @return
+	 */
+	qint64 allocations() const;
+
+	/// for QImage over block of pool
+	static void release_image(void* ptr);
+
+private:
+	BufferPool();
+	~BufferPool();
+
+	struct Block{
+		void* ptr;
+		size_t bytes;
+	};
+
+	mutable QMutex m_mutex;
+	/// size of every block of pool (free and used)
+	QHash< void*, size_t > m_sizes;
+	/// free blocks, the oldest first
+	QList< Block > m_free;
+	size_t m_free_bytes;
+	size_t m_limit;
+	qint64 m_allocations;
+
+	void trim();
+};
+
+//////////////////////////////////////////////
+/// Matrix
+/// row i begins at at(i), rows are "stride" elements apart and aligned to BufferPool::ALIGNMENT.
+/// "halo" pixels around (rows and columns -halo..-1, rows..rows+halo-1 and the same of columns)
+/// are in buffer too, fill_halo() makes them mirror of matrix, so kernels read neighbours without checks.
+/// memory is taken from BufferPool and returned to it, for trivial types only
+
+template< typename T >
+struct Mat{
+	explicit Mat()
+		: rows(0)
+		, cols(0)
+		, stride(0)
+		, halo(0)
+		, data(0)
+		, origin(0)
+	{
+	}
+	/// zero matrix
+	Mat(int rows, int cols, int halo = 0)
+		: rows(0)
+		, cols(0)
+		, stride(0)
+		, halo(0)
+		, data(0)
+		, origin(0)
+	{
+		create(rows, cols, halo);
+		if(data)
+			memset(data, 0, buffer_size() * sizeof(T));
+	}
+	Mat(const Mat< T >& m)
+		: rows(0)
+		, cols(0)
+		, stride(0)
+		, halo(0)
+		, data(0)
+		, origin(0)
+	{
+		*this = m;
+	}
+	Mat(Mat< T >&& m) Q_DECL_NOEXCEPT
+		: rows(m.rows)
+		, cols(m.cols)
+		, stride(m.stride)
+		, halo(m.halo)
+		, data(m.data)
+		, origin(m.origin)
+	{
+		m.rows = m.cols = m.stride = m.halo = 0;
+		m.data = m.origin = 0;
+	}
+	~Mat(){
+		clear();
+	}
+	Mat& operator= (const Mat< T >& m){
+		if(this != &m){
+			create(m.rows, m.cols, m.halo);
+			if(data)
+				memcpy(data, m.data, buffer_size() * sizeof(T));
+		}
+		return *this;
+	}
+	Mat& operator= (Mat< T >&& m) Q_DECL_NOEXCEPT{
+		swap(m);
+		m.clear();
+		return *this;
+	}
+	/**
+	 * @brief create
+	 * matrix of size without initialization; buffer is kept if it has the same size.
+	 * matrix is empty if there is no memory
+	 * @param rows
+	 * @param cols
+	 * @param halo - pixels around matrix
+	 */
+	void create(int rows, int cols, int halo = 0){
+		rows = qMax(0, rows);
+		cols = qMax(0, cols);
+		halo = qMax(0, halo);
+		if(!rows || !cols){
+			clear();
+			return;
+		}
+		/// column 0 and begin of every row are aligned
+		const int align = BufferPool::ALIGNMENT / sizeof(T);
+		const int pad = (halo + align - 1) / align * align;
+		const int stride = (pad + cols + halo + align - 1) / align * align;
+		const size_t count = (size_t)(rows + 2 * halo) * stride;
+		if(count != buffer_size()){
+			clear();
+			data = static_cast< T* >(BufferPool::instance().acquire(count * sizeof(T)));
+			if(!data)
+				return;
+		}
+		this->rows = rows;
+		this->cols = cols;
+		this->stride = stride;
+		this->halo = halo;
+		origin = data + (size_t)halo * stride + pad;
+	}
+	/**
+	 * @brief fill_halo
+	 * pixels around matrix are mirror of it (parity of coordinates is kept, as bayer pattern)
+	 */
+	void fill_halo(){
+		if(!halo || empty())
+			return;
+		for(int i = 0; i < rows; ++i){
+			fill_halo_row(i);
+		}
+		/// rows with their halo columns
+		const size_t bytes = (size_t)(cols + 2 * halo) * sizeof(T);
+		for(int k = 1; k <= halo; ++k){
+			memcpy(at(-k) - halo, at(mirror(-k, rows)) - halo, bytes);
+			memcpy(at(rows - 1 + k) - halo, at(mirror(rows - 1 + k, rows)) - halo, bytes);
+		}
+	}
+	/**
+	 * @brief fill_halo_row
+	 * only columns of halo of row i (-halo <= i < rows + halo), for rows which are filled by caller
+	 * (e.g. strip of frame with real neighbour rows in place of halo)
+	 */
+	void fill_halo_row(int i){
+		T* d = at(i);
+		for(int k = 1; k <= halo; ++k){
+			d[-k] = d[mirror(-k, cols)];
+			d[cols - 1 + k] = d[mirror(cols - 1 + k, cols)];
+		}
+	}
+	inline T& operator() (int i0, int i1){
+		return origin[(qint64)i0 * stride + i1];
+	}
+	inline T& operator[] (int i0){
+		return origin[(qint64)i0 * stride];
+	}
+	inline const T& operator[] (int i0) const{
+		return origin[(qint64)i0 * stride];
+	}
+	inline const T* at(int i0) const{
+		return origin + (qint64)i0 * stride;
+	}
+	inline T* at(int i0){
+		return origin + (qint64)i0 * stride;
+	}
+	inline T& at(int i0, int i1){
+		return origin[(qint64)i0 * stride + i1];
+	}
+	inline const T& at(int i0, int i1) const{
+		return origin[(qint64)i0 * stride + i1];
+	}
+	void clear(){
+		if(data)
+			BufferPool::instance().release(data);
+		rows = cols = stride = halo = 0;
+		data = origin = 0;
+	}
+	bool empty() const{
+		return data == 0;
+	}
+	/// elements of matrix (without halo)
+	size_t size() const{
+		return (size_t)rows * cols;
+	}
+	/// elements of buffer with halo and padding
+	size_t buffer_size() const{
+		return (size_t)(rows + 2 * halo) * stride;
+	}
+	void swap(Mat< T >& m){
+		std::swap(rows, m.rows);
+		std::swap(cols, m.cols);
+		std::swap(stride, m.stride);
+		std::swap(halo, m.halo);
+		std::swap(data, m.data);
+		std::swap(origin, m.origin);
+	}
+
+	/// coordinate reflected at border (parity is kept), for any distance from matrix
+	static inline int mirror(int i, int n){
+		if(n < 2)
+			return 0;
+		const int period = 2 * (n - 1);
+		i %= period;
+		if(i < 0)
+			i += period;
+		return i < n? i : period - i;
+	}
+
+	int rows;
+	int cols;
+	/// elements from row to row
+	int stride;
+	int halo;
+	/// begin of buffer
+	T* data;
+	/// element (0, 0)
+	T* origin;
+};
+
+#endif // MAT_H
@@ -0,0 +1,105 @@
+#ifndef PIXEL_OUT_H
+#define PIXEL_OUT_H
+
+#include <QtGlobal>
+
+///////////////////////////////////////////////
+/// output of demoscaling kernels. kernels compute 16-bit channels and give them to policy:
+/// map() - conversion of one channel, pack() - pixel from converted channels
+///
+
+namespace pixel{
+
+/////////////////////////////////
+/// \brief The Tone8 struct
+/// ARGB32 through tone table
+struct Tone8{
+	typedef uint Pixel;
+	enum{ BITS = 8 };
+
+	const uchar* lut;
+
+	/// table for vector gather
+	inline const uchar* table() const{
+		return lut;
+	}
+	inline int map(int value) const{
+		return lut[value];
+	}
+	static inline Pixel pack(int red, int green, int blue){
+		return blue | (green << 8) | (red << 16) | 0xff000000u;
+	}
+	inline Pixel operator()(int red, int green, int blue) const{
+		return pack(map(red), map(green), map(blue));
+	}
+};
+
+/////////////////////////////////
+/// \brief The Rgb16 struct
+/// 16 bit by channel before tone mapping, layout of QRgba64 (red in low word, alpha 0xffff)
+struct Rgb16{
+	typedef quint64 Pixel;
+	enum{ BITS = 16 };
+
+	inline const uchar* table() const{
+		return 0;
+	}
+	inline int map(int value) const{
+		return value;
+	}
+	static inline Pixel pack(int red, int green, int blue){
+		return ((uint)red | ((uint)green << 16)) | ((quint64)((uint)blue | 0xffff0000u) << 32);
+	}
+	inline Pixel operator()(int red, int green, int blue) const{
+		return pack(red, green, blue);
+	}
+};
+
+/////////////////////////////////
+/// \brief The Correction struct
+/// black level, white balance and color matrix in fixed point (see ColorCorrection::fixed):
+/// out[c] = clamp((m[3c] * r + m[3c + 1] * g + m[3c + 2] * b + ROUND) >> BITS, 0, MAX), r = max(0, red - black[0]) ...
+/// rows of m have sum of modules not more than 15 << BITS, so every sum fits in 32 bit (vector kernels give the same result)
+struct Correction{
+	enum{
+		BITS = 11,
+		ROUND = 1 << (BITS - 1),
+		MAX = 65535
+	};
+
+	int black[3];
+	int m[9];
+
+	inline void operator()(int& red, int& green, int& blue) const{
+		const int r = qMax(0, red - black[0]);
+		const int g = qMax(0, green - black[1]);
+		const int b = qMax(0, blue - black[2]);
+		red = qBound(0, (m[0] * r + m[1] * g + m[2] * b + ROUND) >> BITS, (int)MAX);
+		green = qBound(0, (m[3] * r + m[4] * g + m[5] * b + ROUND) >> BITS, (int)MAX);
+		blue = qBound(0, (m[6] * r + m[7] * g + m[8] * b + ROUND) >> BITS, (int)MAX);
+	}
+};
+
+/////////////////////////////////
+/// \brief The Corrected struct
+/// policy O after Correction, for kernels which give every pixel to policy
+template< typename O >
+struct Corrected{
+	typedef typename O::Pixel Pixel;
+	enum{ BITS = O::BITS };
+
+	O o;
+	Correction c;
+
+	inline const uchar* table() const{
+		return o.table();
+	}
+	inline Pixel operator()(int red, int green, int blue) const{
+		c(red, green, blue);
+		return o(red, green, blue);
+	}
+};
+
+}
+
+#endif // PIXEL_OUT_H
@@ -0,0 +1,113 @@
+#include "pyramid.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+
+namespace pyramid{
+
+/////////////////////////////////
+/// \brief half_rows
+/// rows [y0, y1) of half image. channels are summed in pairs in one 32-bit word
+static void half_rows(const QImage& src, QImage& dst, int y0, int y1)
+{
+	const int width = dst.width();
+	for(int i = y0; i < y1; ++i){
+		const quint32* s0 = reinterpret_cast< const quint32* >(src.constScanLine(2 * i));
+		const quint32* s1 = reinterpret_cast< const quint32* >(src.constScanLine(2 * i + 1));
+		quint32* d = reinterpret_cast< quint32* >(dst.scanLine(i));
+		for(int j = 0; j < width; ++j){
+			const quint32 p0 = s0[2 * j], p1 = s0[2 * j + 1], p2 = s1[2 * j], p3 = s1[2 * j + 1];
+			/// blue and red, alpha and green: 10 bits of sum in every 16-bit lane
+			quint32 lo = (p0 & 0x00ff00ff) + (p1 & 0x00ff00ff) + (p2 & 0x00ff00ff) + (p3 & 0x00ff00ff);
+			quint32 hi = ((p0 >> 8) & 0x00ff00ff) + ((p1 >> 8) & 0x00ff00ff)
+					+ ((p2 >> 8) & 0x00ff00ff) + ((p3 >> 8) & 0x00ff00ff);
+			lo = ((lo + 0x00020002) >> 2) & 0x00ff00ff;
+			hi = ((hi + 0x00020002) >> 2) & 0x00ff00ff;
+			d[j] = lo | (hi << 8);
+		}
+	}
+}
+
+/////////////////////////////////
+/// \brief The HalfTask class
+/// band of rows, semaphore is released when done (canceled too)
+
+class HalfTask: public QRunnable{
+public:
+	HalfTask(const QImage& src, QImage& dst, int y0, int y1, const std::function< bool() >& canceled, QSemaphore* done)
+		: m_src(src)
+		, m_dst(dst)
+		, m_y0(y0)
+		, m_y1(y1)
+		, m_canceled(canceled)
+		, m_done(done)
+	{
+	}
+	virtual void run(){
+		for(int y = m_y0; y < m_y1 && !(m_canceled && m_canceled()); y += CANCEL_ROWS){
+			half_rows(m_src, m_dst, y, qMin(y + CANCEL_ROWS, m_y1));
+		}
+		m_done->release();
+	}
+
+private:
+	const QImage& m_src;
+	QImage& m_dst;
+	int m_y0;
+	int m_y1;
+	const std::function< bool() >& m_canceled;
+	QSemaphore* m_done;
+};
+
+QImage half(const QImage &image, const std::function< bool() > &canceled)
+{
+	const QImage src = image.format() == QImage::Format_ARGB32? image : image.convertToFormat(QImage::Format_ARGB32);
+	QImage dst(src.width() / 2, src.height() / 2, QImage::Format_ARGB32);
+	if(dst.isNull())
+		return dst;
+
+	/// bits() of shared image would detach in threads
+	dst.bits();
+
+	const int rows = dst.height();
+	const int bands = qMax(1, qMin(QThread::idealThreadCount(), rows / 16));
+
+	QSemaphore done;
+	for(int k = 0; k < bands; ++k){
+		HalfTask* task = new HalfTask(src, dst, rows * k / bands, rows * (k + 1) / bands, canceled, &done);
+		task->setAutoDelete(true);
+		QThreadPool::globalInstance()->start(task);
+	}
+	done.acquire(bands);
+	/// rows after cancel are not written
+	if(canceled && canceled())
+		return QImage();
+	return dst;
+}
+
+QVector< QImage > build(const QImage &image, int min_size, const std::function< bool() > &canceled)
+{
+	QVector< QImage > levels;
+	QImage level = image;
+	while(level.width() / 2 >= min_size && level.height() / 2 >= min_size && !canceled()){
+		/// cancel is checked by bands of rows, not only between levels
+		level = half(level, canceled);
+		if(level.isNull())
+			break;
+		levels << level;
+	}
+	return levels;
+}
+
+const QImage &nearest(const QImage &image, const QVector< QImage > &levels, const QSize &size)
+{
+	for(int i = levels.size() - 1; i >= 0; --i){
+		if(levels[i].width() >= size.width() && levels[i].height() >= size.height())
+			return levels[i];
+	}
+	return image;
+}
+
+}
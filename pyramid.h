@@ -0,0 +1,51 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <QImage>
+#include <QVector>
+
+#include <functional>
+
+///////////////////////////////////////////////
+/// levels of image for drawing with scale < 1: every level is half of previous (box 2x2).
+/// drawing from the nearest level costs about size of screen, not size of frame
+///
+
+namespace pyramid{
+
+/// rows of output between checks of cancel
+enum{
+	CANCEL_ROWS = 64
+};
+
+/**
+ * @brief half
+ * image of half size (ARGB32), every pixel is mean of quad 2x2 with rounding.
+ * rows are computed by threads of global pool
+ * @param image
+ * @param canceled - checked by every band of CANCEL_ROWS rows, rest of image is not computed
+ * @return null image if it was canceled
+ */
+QImage half(const QImage& image, const std::function< bool() >& canceled = std::function< bool() >());
+/**
+ * @brief build
+ * levels after image while both sides of next level are not less than min_size
+ * @param image
+ * @param min_size
+ * @param canceled - building is stopped if it returns true
+ * @return
+ */
+QVector< QImage > build(const QImage& image, int min_size, const std::function< bool() >& canceled);
+/**
+ * @brief nearest
+ * the smallest of image and levels which is not less than size
+ * @param image
+ * @param levels
+ * @param size
+ * @return
+ */
+const QImage& nearest(const QImage& image, const QVector< QImage >& levels, const QSize& size);
+
+}
+
+#endif // PYRAMID_H
@@ -0,0 +1,280 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVector>
+#include <QtEndian>
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "rawreader.h"
+
+//////////////////////////////////////////////
+/// \brief The Stage struct
+/// measured stage: demoscaling mode and its settings
+
+struct Stage{
+	const char* name;
+	RawReader::TYPE_DEMOSCALE demoscaling;
+	simd::LEVEL level;
+	int lshift;
+	bool incremental;	/// cached demoscaling: only tone mapping is measured
+	bool color;			/// black level, white balance and matrix of typical camera (see camera_color)
+};
+
+/// ingest is measured separately, other stages are RawReader::compute()
+static const Stage stages[] = {
+	{ "gray",			RawReader::GRAY,	simd::AVX2,		0, false, false },
+	{ "simple",			RawReader::SIMPLE,	simd::AVX2,		0, false, false },
+	{ "linear_ref",		RawReader::LINEAR,	simd::SCALAR,	0, false, false },
+	{ "linear_sse2",	RawReader::LINEAR,	simd::SSE2,		0, false, false },
+	{ "linear_avx2",	RawReader::LINEAR,	simd::AVX2,		0, false, false },
+	{ "linear_color",	RawReader::LINEAR,	simd::AVX2,		0, false, true },
+	{ "linear_lshift",	RawReader::LINEAR,	simd::AVX2,		2, false, false },
+	{ "malvar",			RawReader::MALVAR,	simd::AVX2,		0, false, false },
+	{ "vng",			RawReader::VNG,		simd::AVX2,		0, false, false },
+	{ "ahd",			RawReader::AHD,		simd::AVX2,		0, false, false },
+	{ "half",			RawReader::HALF,	simd::AVX2,		0, false, false },
+	{ "tone",			RawReader::LINEAR,	simd::AVX2,		0, true, false },
+};
+
+/////////////////////////////////
+/// \brief camera_color
+/// correction of order of real cameras: black of 12-bit sensor, daylight gains and matrix to sRGB
+static ColorCorrection camera_color()
+{
+	const double black[3] = { 256, 256, 256 };
+	const double gains[3] = { 2.1, 1, 1.6 };
+	const double matrix[9] = { 1.72, -0.55, -0.17, -0.21, 1.45, -0.24, 0.03, -0.62, 1.59 };
+	ColorCorrection res;
+	for(int c = 0; c < 3; ++c){
+		res.black[c] = black[c];
+		res.gains[c] = gains[c];
+	}
+	for(int k = 0; k < 9; ++k){
+		res.matrix[k] = matrix[k];
+	}
+	return res;
+}
+
+/////////////////////////////////
+/// \brief make_frame
+/// deterministic stream of RAW_TYPE_1: gradient with 12-bit noise from fixed seed
+static QByteArray make_frame(int width, int height, quint32 seed)
+{
+	const int header = 2 * sizeof(qint32);
+	QByteArray data(header + width * height * (int)sizeof(ushort), 0);
+	uchar* d = reinterpret_cast< uchar* >(data.data());
+
+	qToLittleEndian< qint32 >(width, d);
+	qToLittleEndian< qint32 >(height, d + sizeof(qint32));
+	d += header;
+
+	quint32 state = seed;
+	for(int i = 0; i < height; ++i){
+		for(int j = 0; j < width; ++j){
+			/// LCG of Numerical Recipes
+			state = state * 1664525u + 1013904223u;
+			int value = ((i + j) * 2048 / (width + height)) + (state >> 24) + ((i & 1) ^ (j & 1)) * 512;
+			qToLittleEndian< quint16 >(qMin(value, 4095), d);
+			d += sizeof(ushort);
+		}
+	}
+	return data;
+}
+
+/////////////////////////////////
+/// \brief The Stat struct
+/// statistics of runs, ms
+
+struct Stat{
+	double median;
+	double p95;
+	double min;
+	double max;
+};
+
+static Stat statistics(QVector< double > times)
+{
+	Stat res = { 0, 0, 0, 0 };
+	if(times.isEmpty())
+		return res;
+	std::sort(times.begin(), times.end());
+	int n = times.size();
+	res.median = n & 1? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+	/// nearest rank
+	res.p95 = times[qBound(0, (int)ceil(0.95 * n) - 1, n - 1)];
+	res.min = times.first();
+	res.max = times.last();
+	return res;
+}
+
+/////////////////////////////////
+/// \brief measure
+/// warmup runs are not counted
+/// @param allocations - blocks allocated by BufferPool in measured runs (0 at steady state)
+template< typename F >
+static QVector< double > measure(int warmup, int repeat, F func, qint64* allocations)
+{
+	QVector< double > times;
+	QElapsedTimer timer;
+	qint64 allocated = 0;
+	for(int i = 0; i < warmup + repeat; ++i){
+		if(i == warmup)
+			allocated = BufferPool::instance().allocations();
+		timer.start();
+		func();
+		double ms = timer.nsecsElapsed() / 1e6;
+		if(i >= warmup)
+			times << ms;
+	}
+	*allocations = BufferPool::instance().allocations() - allocated;
+	return times;
+}
+
+static QJsonObject report(const QString& stage, int width, int height, const QVector< double >& times, qint64 allocations)
+{
+	Stat st = statistics(times);
+	double mp = (double)width * height / 1e6;
+
+	QJsonArray runs;
+	foreach (double t, times) {
+		runs.append(t);
+	}
+
+	QJsonObject obj;
+	obj["stage"] = stage;
+	obj["width"] = width;
+	obj["height"] = height;
+	obj["mp"] = mp;
+	obj["median_ms"] = st.median;
+	obj["p95_ms"] = st.p95;
+	obj["min_ms"] = st.min;
+	obj["max_ms"] = st.max;
+	obj["mp_per_s"] = st.median > 0? mp / st.median * 1000 : 0;
+	obj["runs_ms"] = runs;
+	obj["allocations"] = allocations;
+
+	fprintf(stderr, "%-14s %6dx%-6d median %9.2f ms, p95 %9.2f ms, %8.1f MP/s, %lld allocations\n",
+			qPrintable(stage), width, height, st.median, st.p95, st.median > 0? mp / st.median * 1000 : 0,
+			(long long)allocations);
+	return obj;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("raw_bench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("benchmark of stages of RawReader on synthetic frames");
+	parser.addHelpOption();
+
+	QCommandLineOption opt_sizes("sizes", "sizes of frames, MP (4:3)", "list", "2,8,24,50,100");
+	QCommandLineOption opt_stages("stages", "ingest,gray,simple,linear_ref,linear_sse2,linear_avx2,linear_color,linear_lshift,malvar,vng,ahd,half,tone",
+								  "list", "ingest,gray,simple,linear_ref,linear_sse2,linear_avx2,linear_color,linear_lshift,malvar");
+	QCommandLineOption opt_warmup("warmup", "runs before measure", "count", "2");
+	QCommandLineOption opt_repeat("repeat", "measured runs", "count", "7");
+	QCommandLineOption opt_threads("threads", "threads of RawReader (default all cores)", "count", "0");
+	QCommandLineOption opt_seed("seed", "seed of synthetic frames", "value", "1");
+	QCommandLineOption opt_output("output", "json report (stdout if not set)", "file");
+
+	parser.addOption(opt_sizes);
+	parser.addOption(opt_stages);
+	parser.addOption(opt_warmup);
+	parser.addOption(opt_repeat);
+	parser.addOption(opt_threads);
+	parser.addOption(opt_seed);
+	parser.addOption(opt_output);
+
+	parser.process(app);
+
+	QStringList sizes = parser.value(opt_sizes).split(",", QString::SkipEmptyParts);
+	QStringList names = parser.value(opt_stages).split(",", QString::SkipEmptyParts);
+	int warmup = qMax(0, parser.value(opt_warmup).toInt());
+	int repeat = qMax(1, parser.value(opt_repeat).toInt());
+	int threads = parser.value(opt_threads).toInt();
+	quint32 seed = parser.value(opt_seed).toUInt();
+
+	RawReader reader;
+	reader.set_type(RawReader::RAW_TYPE_1);
+	if(threads > 0)
+		reader.set_thread_count(threads);
+
+	QJsonArray results;
+
+	foreach (const QString& size, sizes) {
+		double mp = size.toDouble();
+		if(mp <= 0)
+			continue;
+		/// even sizes with aspect 4:3
+		int width = (int)(sqrt(mp * 1e6 * 4 / 3)) & ~1;
+		int height = (int)(mp * 1e6 / width) & ~1;
+
+		QByteArray frame = make_frame(width, height, seed);
+		const uchar* data = reinterpret_cast< const uchar* >(frame.constData());
+
+		if(names.contains("ingest")){
+			qint64 allocations = 0;
+			QVector< double > times = measure(warmup, repeat, [&](){
+				reader.set_bayer_data(data, frame.size());
+			}, &allocations);
+			results.append(report("ingest", width, height, times, allocations));
+		}
+		reader.set_bayer_data(data, frame.size());
+
+		for(size_t k = 0; k < sizeof(stages) / sizeof(*stages); ++k){
+			const Stage& st = stages[k];
+			if(!names.contains(st.name))
+				continue;
+			if(st.level > simd::level()){
+				fprintf(stderr, "%-14s skipped: %s is not supported\n", st.name, simd::level_name(st.level));
+				continue;
+			}
+			reader.set_demoscaling(st.demoscaling);
+			reader.set_simd_level(st.level);
+			reader.set_lshift(st.lshift);
+			reader.set_incremental(st.incremental);
+			reader.set_color(st.color? camera_color() : ColorCorrection());
+			/// first run fills cache
+			if(st.incremental)
+				reader.compute();
+
+			qint64 allocations = 0;
+			QVector< double > times = measure(warmup, repeat, [&](){
+				reader.compute();
+			}, &allocations);
+			results.append(report(st.name, width, height, times, allocations));
+		}
+		reader.clear_bayer();
+	}
+
+	QJsonObject root;
+	root["simd"] = QString(simd::level_name(simd::level()));
+	root["threads"] = reader.thread_count();
+	root["warmup"] = warmup;
+	root["repeat"] = repeat;
+	root["seed"] = (qint64)seed;
+	root["results"] = results;
+
+	QByteArray json = QJsonDocument(root).toJson();
+
+	QString output = parser.value(opt_output);
+	if(output.isEmpty()){
+		fwrite(json.constData(), 1, json.size(), stdout);
+	}else{
+		QFile file(output);
+		if(!file.open(QIODevice::WriteOnly)){
+			fprintf(stderr, "can not write %s\n", qPrintable(output));
+			return 1;
+		}
+		file.write(json);
+	}
+
+	return 0;
+}
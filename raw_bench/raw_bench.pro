@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# benchmark of stages of RawReader on synthetic frames
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = raw_bench
+TEMPLATE = app
+
+include(../rawreader.pri)
+
+SOURCES += main.cpp
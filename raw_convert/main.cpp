@@ -0,0 +1,427 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QImage>
+#include <QScopedPointer>
+
+#include <stdio.h>
+
+#include "rawreader.h"
+
+//////////////////////////////////////////////
+/// \brief The Settings struct
+/// parameters of conversion, the same for all files
+
+struct Settings{
+	int width;
+	int height;
+	RawReader::RAW_TYPE type;
+	RawFormat raw;		/// layout of samples of files
+	int shift;
+	bool auto_shift;	/// shift by histogram of every file
+	int lshift;
+	RawReader::TYPE_DEMOSCALE demoscaling;
+	cfa::PATTERN pattern;
+	ColorCorrection color;	/// black level, white balance and color matrix
+	int threads;
+	QString output;
+	QString format;
+	QString trace;		/// directory of traces of files, empty - not saved
+	int stream;			/// memory of strip in MB, 0 - whole frame is in memory
+};
+
+/////////////////////////////////
+/// \brief The Result struct
+/// result of one file, times in ms
+
+struct Result{
+	Result()
+		: ok(false)
+		, width(0)
+		, height(0)
+		, time_load(0)
+		, time_compute(0)
+		, time_save(0)
+	{
+	}
+	bool ok;
+	int width;
+	int height;
+	double time_load;
+	double time_compute;
+	double time_save;
+};
+
+static QMutex print_mutex;
+
+/////////////////////////////////
+/// \brief print_line
+/// output from workers, line by line
+static void print_line(const QString& text, FILE* stream = stdout)
+{
+	QMutexLocker lock(&print_mutex);
+	fputs(qPrintable(text + "\n"), stream);
+	fflush(stream);
+}
+
+inline double ms(const QElapsedTimer& timer)
+{
+	return timer.nsecsElapsed() / 1e6;
+}
+
+/////////////////////////////////
+/// \brief The NullSink class
+/// strips of streaming without output are only computed
+
+class NullSink: public StreamSink{
+public:
+	virtual bool begin(int, int){
+		return true;
+	}
+	virtual bool write(const QImage&){
+		return true;
+	}
+	virtual bool end(){
+		return true;
+	}
+};
+
+/////////////////////////////////
+/// \brief The ConvertTask class
+/// one file for pool of workers. every file has own RawReader
+
+class ConvertTask: public QRunnable{
+public:
+	ConvertTask(const Settings& settings, const QString& fileName, Result* result)
+		: m_settings(settings)
+		, m_fileName(fileName)
+		, m_result(result)
+	{
+	}
+	virtual void run(){
+		RawReader reader;
+		reader.set_type(m_settings.type);
+		reader.set_format(m_settings.raw);
+		if(m_settings.type == RawReader::RAW_TYPE_2)
+			reader.set_size(m_settings.width, m_settings.height);
+		reader.set_shift(m_settings.shift);
+		reader.set_auto_shift(m_settings.auto_shift);
+		reader.set_lshift(m_settings.lshift);
+		reader.set_demoscaling(m_settings.demoscaling);
+		reader.set_pattern(m_settings.pattern);
+		reader.set_color(m_settings.color);
+		reader.set_thread_count(m_settings.threads);
+
+		if(!(m_settings.stream > 0? stream(reader) : convert(reader)))
+			return;
+		m_result->ok = true;
+
+		if(!m_settings.trace.isEmpty()){
+			QString name = QDir(m_settings.trace).filePath(QFileInfo(m_fileName).completeBaseName() + ".trace.json");
+			if(!reader.trace().save(name))
+				print_line(QString("%1: can not write %2").arg(m_fileName).arg(name), stderr);
+		}
+
+		double mp = (double)m_result->width * m_result->height / 1e6;
+		double total = m_result->time_load + m_result->time_compute + m_result->time_save;
+		print_line(QString("%1: %2x%3, load %4 ms, compute %5 ms, save %6 ms, %7 MP/s%8")
+				   .arg(m_fileName)
+				   .arg(m_result->width).arg(m_result->height)
+				   .arg(m_result->time_load, 0, 'f', 1)
+				   .arg(m_result->time_compute, 0, 'f', 1)
+				   .arg(m_result->time_save, 0, 'f', 1)
+				   .arg(total > 0? mp / total * 1000 : 0, 0, 'f', 1)
+				   .arg(m_settings.auto_shift? QString(", shift %1").arg(reader.shift()) : QString()));
+	}
+
+private:
+	const Settings& m_settings;
+	QString m_fileName;
+	Result* m_result;
+
+	QString output_name(const QString& format) const{
+		return QDir(m_settings.output).filePath(QFileInfo(m_fileName).completeBaseName() + "." + format);
+	}
+	/// whole frame in memory, image is saved by QImage
+	bool convert(RawReader& reader){
+		QElapsedTimer timer;
+		timer.start();
+		if(!reader.open_file(m_fileName)){
+			print_line(QString("%1: can not read").arg(m_fileName), stderr);
+			return false;
+		}
+		m_result->time_load = ms(timer);
+
+		timer.restart();
+		reader.compute();
+		m_result->time_compute = ms(timer);
+
+		m_result->width = reader.width();
+		m_result->height = reader.height();
+
+		if(!m_settings.output.isEmpty()){
+			QString name = output_name(m_settings.format);
+			timer.restart();
+			ScopedTimer stage(&reader.trace(), "save");
+			if(!reader.image().save(name)){
+				print_line(QString("%1: can not write %2").arg(m_fileName).arg(name), stderr);
+				return false;
+			}
+			m_result->time_save = ms(timer);
+		}
+		return true;
+	}
+	/// strips of rows: reading, demoscaling and writing are one pass (its time is compute), output is PPM
+	bool stream(RawReader& reader){
+		QElapsedTimer timer;
+		timer.start();
+		reader.set_stream_memory(m_settings.stream);
+
+		NullSink none;
+		QString name;
+		QScopedPointer< PpmSink > ppm;
+		if(!m_settings.output.isEmpty()){
+			name = output_name("ppm");
+			ppm.reset(new PpmSink(name));
+		}
+		if(!reader.stream_raw(m_fileName, ppm.isNull()? static_cast< StreamSink* >(&none) : ppm.data())){
+			print_line(QString("%1: can not convert to %2").arg(m_fileName).arg(name.isEmpty()? "nothing" : name), stderr);
+			return false;
+		}
+		m_result->time_compute = ms(timer);
+		m_result->width = reader.width();
+		m_result->height = reader.height();
+		return true;
+	}
+};
+
+/////////////////////////////////
+
+static bool parse_demoscaling(const QString& value, RawReader::TYPE_DEMOSCALE& res)
+{
+	static const char* names[] = { "gray", "simple", "linear", "malvar", "vng", "ahd", "half" };
+	for(int i = 0; i < 7; ++i){
+		if(value.compare(names[i], Qt::CaseInsensitive) == 0){
+			res = static_cast< RawReader::TYPE_DEMOSCALE >(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_pattern(const QString& value, cfa::PATTERN& res)
+{
+	for(int i = cfa::RGGB; i <= cfa::GBRG; ++i){
+		if(value.compare(cfa::name(static_cast< cfa::PATTERN >(i)), Qt::CaseInsensitive) == 0){
+			res = static_cast< cfa::PATTERN >(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/////////////////////////////////
+/// \brief collect_files
+/// files from arguments: directories are listed (raw and bin), "@file" is list of files by line
+static QStringList collect_files(const QStringList& args)
+{
+	QStringList res;
+	foreach (const QString& arg, args) {
+		if(arg.startsWith("@")){
+			QFile list(arg.mid(1));
+			if(!list.open(QIODevice::ReadOnly | QIODevice::Text)){
+				print_line(QString("can not read list %1").arg(list.fileName()), stderr);
+				continue;
+			}
+			while(!list.atEnd()){
+				QString line = QString::fromLocal8Bit(list.readLine()).trimmed();
+				if(!line.isEmpty())
+					res << line;
+			}
+			continue;
+		}
+		QFileInfo info(arg);
+		if(info.isDir()){
+			QDir dir(arg);
+			QStringList names = dir.entryList(QStringList() << "*.raw" << "*.bin", QDir::Files, QDir::Name);
+			foreach (const QString& name, names) {
+				res << dir.filePath(name);
+			}
+		}else{
+			res << arg;
+		}
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("raw_convert");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("headless batch converter of raw files");
+	parser.addHelpOption();
+	parser.addPositionalArgument("files", "files, directories or @list of files", "[files...]");
+
+	QCommandLineOption opt_width("width", "width of frame (type 2)", "value", "0");
+	QCommandLineOption opt_height("height", "height of frame (type 2)", "value", "0");
+	QCommandLineOption opt_type("type", "1 - stream with width and height, 2 - without", "1|2", "1");
+	QCommandLineOption opt_raw("raw", "samples: le16, be16, le12 (12 bits in 16), raw10, raw12, raw14 (MIPI)", "format", "le16");
+	QCommandLineOption opt_header("header", "bytes before payload of frame (after width and height of type 1)", "bytes", "0");
+	QCommandLineOption opt_stride("stride", "bytes from row to row (0 - rows without padding)", "bytes", "0");
+	QCommandLineOption opt_shift("shift", "right shift of pixel value, auto - by histogram of every file", "bits|auto", "4");
+	QCommandLineOption opt_lshift("lshift", "left shift of source value", "bits", "0");
+	QCommandLineOption opt_demosaic("demosaic", "gray, simple, linear, malvar, vng, ahd, half (2x2 to one pixel)", "mode", "linear");
+	QCommandLineOption opt_pattern("pattern", "RGGB, BGGR, GRBG, GBRG", "pattern", "GRBG");
+	QCommandLineOption opt_black("black", "black level of red, green, blue in source values (one value for all)", "r,g,b", "0");
+	QCommandLineOption opt_wb("wb", "white balance gains of red, green, blue", "r,g,b", "1,1,1");
+	QCommandLineOption opt_matrix("matrix", "camera rgb to sRGB by rows", "m00,...,m22", "1,0,0,0,1,0,0,0,1");
+	QCommandLineOption opt_jobs("jobs", "files in parallel", "count", QString::number(QThread::idealThreadCount()));
+	QCommandLineOption opt_threads("threads", "threads of one file (default cores / jobs)", "count", "0");
+	QCommandLineOption opt_output("output", "directory of images (without it files are only computed)", "dir");
+	QCommandLineOption opt_format("format", "format of images", "ext", "png");
+	QCommandLineOption opt_trace("trace", "directory of traces of files (chrome://tracing, Perfetto)", "dir");
+	QCommandLineOption opt_stream("stream", "convert by strips of rows in memory of MB (any size of frame, output is ppm)", "MB", "0");
+	QCommandLineOption opt_index("index", "only build frame index with checksums (<file>.idx) of streams of type 1");
+
+	parser.addOption(opt_width);
+	parser.addOption(opt_height);
+	parser.addOption(opt_type);
+	parser.addOption(opt_raw);
+	parser.addOption(opt_header);
+	parser.addOption(opt_stride);
+	parser.addOption(opt_shift);
+	parser.addOption(opt_lshift);
+	parser.addOption(opt_demosaic);
+	parser.addOption(opt_pattern);
+	parser.addOption(opt_black);
+	parser.addOption(opt_wb);
+	parser.addOption(opt_matrix);
+	parser.addOption(opt_jobs);
+	parser.addOption(opt_threads);
+	parser.addOption(opt_output);
+	parser.addOption(opt_format);
+	parser.addOption(opt_trace);
+	parser.addOption(opt_stream);
+	parser.addOption(opt_index);
+
+	parser.process(app);
+
+	Settings settings;
+	settings.width = parser.value(opt_width).toInt();
+	settings.height = parser.value(opt_height).toInt();
+	settings.type = parser.value(opt_type).toInt() == 2? RawReader::RAW_TYPE_2 : RawReader::RAW_TYPE_1;
+	settings.auto_shift = parser.value(opt_shift) == "auto";
+	settings.shift = settings.auto_shift? 4 : parser.value(opt_shift).toInt();
+	settings.lshift = parser.value(opt_lshift).toInt();
+	settings.output = parser.value(opt_output);
+	settings.format = parser.value(opt_format);
+	settings.trace = parser.value(opt_trace);
+	settings.stream = parser.value(opt_stream).toInt();
+
+	bool known = false;
+	settings.raw = RawFormat::from_name(parser.value(opt_raw), &known);
+	settings.raw.header = parser.value(opt_header).toLongLong();
+	settings.raw.stride = parser.value(opt_stride).toLongLong();
+	if(!known || !settings.raw.is_valid()){
+		print_line(QString("unknown raw format %1").arg(parser.value(opt_raw)), stderr);
+		return 2;
+	}
+	if(!parse_demoscaling(parser.value(opt_demosaic), settings.demoscaling)){
+		print_line(QString("unknown demosaic mode %1").arg(parser.value(opt_demosaic)), stderr);
+		return 2;
+	}
+	if(!parse_pattern(parser.value(opt_pattern), settings.pattern)){
+		print_line(QString("unknown pattern %1").arg(parser.value(opt_pattern)), stderr);
+		return 2;
+	}
+	if(!ColorCorrection::parse(parser.value(opt_black), settings.color.black, 3)
+			|| !ColorCorrection::parse(parser.value(opt_wb), settings.color.gains, 3)
+			|| !ColorCorrection::parse(parser.value(opt_matrix), settings.color.matrix, 9)){
+		print_line("black, wb and matrix are lists of 3, 3 and 9 numbers", stderr);
+		return 2;
+	}
+	if(settings.type == RawReader::RAW_TYPE_2 && (settings.width <= 0 || settings.height <= 0)){
+		print_line("width and height are needed for type 2", stderr);
+		return 2;
+	}
+
+	int jobs = qMax(1, parser.value(opt_jobs).toInt());
+	settings.threads = parser.value(opt_threads).toInt();
+	if(settings.threads <= 0)
+		settings.threads = qMax(1, QThread::idealThreadCount() / jobs);
+
+	QStringList files = collect_files(parser.positionalArguments());
+	if(files.isEmpty()){
+		parser.showHelp(1);
+	}
+
+	if(parser.isSet(opt_index)){
+		int failed = 0;
+		foreach (const QString& fileName, files) {
+			FrameIndex index;
+			if(index.build(fileName, settings.raw, true) && index.save()){
+				print_line(QString("%1: %2 frames").arg(fileName).arg(index.size()));
+			}else{
+				print_line(QString("%1: is not indexed").arg(fileName), stderr);
+				failed++;
+			}
+		}
+		return failed? 1 : 0;
+	}
+
+	if(!settings.output.isEmpty() && !QDir().mkpath(settings.output)){
+		print_line(QString("can not create %1").arg(settings.output), stderr);
+		return 2;
+	}
+	if(!settings.trace.isEmpty() && !QDir().mkpath(settings.trace)){
+		print_line(QString("can not create %1").arg(settings.trace), stderr);
+		return 2;
+	}
+
+	/// bounded pool: not more than "jobs" files in memory
+	QThreadPool pool;
+	pool.setMaxThreadCount(jobs);
+
+	QVector< Result > results(files.size());
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for(int i = 0; i < files.size(); ++i){
+		ConvertTask* task = new ConvertTask(settings, files[i], &results[i]);
+		task->setAutoDelete(true);
+		pool.start(task);
+	}
+	pool.waitForDone();
+
+	double wall = ms(timer) / 1000;
+
+	int done = 0;
+	double mp = 0;
+	foreach (const Result& res, results) {
+		if(res.ok){
+			done++;
+			mp += (double)res.width * res.height / 1e6;
+		}
+	}
+
+	print_line(QString("files: %1 done, %2 failed; jobs %3, threads %4")
+			   .arg(done).arg(files.size() - done).arg(jobs).arg(settings.threads));
+	print_line(QString("total: %1 MP in %2 s, %3 MP/s, %4 files/s")
+			   .arg(mp, 0, 'f', 1)
+			   .arg(wall, 0, 'f', 2)
+			   .arg(wall > 0? mp / wall : 0, 0, 'f', 1)
+			   .arg(wall > 0? done / wall : 0, 0, 'f', 2));
+
+	return done == files.size()? 0 : 1;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# headless batch converter of raw files
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = raw_convert
+TEMPLATE = app
+
+include(../rawreader.pri)
+
+SOURCES += main.cpp
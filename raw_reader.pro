@@ -1,24 +1,18 @@
 #-------------------------------------------------
 #
-# Project created by QtCreator 2015-10-20T14:09:13
+# raw_reader - viewer (widgets)
+# raw_convert - headless batch converter (QtCore, QtGui)
+# raw_bench - benchmark of stages with json report
 #
 #-------------------------------------------------
 
-QT       += core gui xml
+TEMPLATE = subdirs
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+SUBDIRS += raw_reader \
+    raw_convert \
+    raw_bench
 
-TARGET = raw_reader
-TEMPLATE = app
-
-
-SOURCES += main.cpp\
-        mainwindow.cpp \
-    rawreader.cpp \
-    imageoutput.cpp
-
-HEADERS  += mainwindow.h \
-    rawreader.h \
-    imageoutput.h
-
-FORMS    += mainwindow.ui
+raw_reader.file = raw_reader_app.pro
+raw_reader.makefile = Makefile.raw_reader
+raw_convert.subdir = raw_convert
+raw_bench.subdir = raw_bench
@@ -0,0 +1,27 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2015-10-20T14:09:13
+#
+#-------------------------------------------------
+
+QT       += core gui xml
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = raw_reader
+TEMPLATE = app
+
+include(rawreader.pri)
+
+SOURCES += main.cpp\
+        mainwindow.cpp \
+    imageoutput.cpp \
+    pyramid.cpp \
+    histogramwidget.cpp
+
+HEADERS  += mainwindow.h \
+    imageoutput.h \
+    pyramid.h \
+    histogramwidget.h
+
+FORMS    += mainwindow.ui
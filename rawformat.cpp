@@ -0,0 +1,407 @@
+#include "rawformat.h"
+#include "simd_target.h"
+
+#include <QRegExp>
+
+#include <string.h>
+
+/// frame may be longer than rest of file this times (plus small frames), more is not a frame
+static const qint64 missing_factor = 4;
+static const qint64 missing_bytes = 1 << 20;
+
+RawFormat::RawFormat()
+	: bits(16)
+	, packing(PLAIN)
+	, endian(LITTLE)
+	, header(0)
+	, stride(0)
+{
+}
+
+bool RawFormat::is_valid() const
+{
+	if(header < 0 || stride < 0)
+		return false;
+	if(packing == MIPI)
+		return bits == 10 || bits == 12 || bits == 14;
+	return bits >= 8 && bits <= 16;
+}
+
+int RawFormat::group() const
+{
+	if(packing == MIPI)
+		return bits == 12? 2 : 4;
+	return 1;
+}
+
+int RawFormat::group_bytes() const
+{
+	if(packing == MIPI)
+		return group() * bits / 8;
+	return sizeof(ushort);
+}
+
+qint64 RawFormat::packed_bytes(int count) const
+{
+	const int g = group();
+	return (qint64)(count + g - 1) / g * group_bytes();
+}
+
+qint64 RawFormat::row_bytes(int width) const
+{
+	/// stride shorter than row would overlap rows, it is ignored
+	return qMax(stride, packed_bytes(width));
+}
+
+qint64 RawFormat::frame_bytes(int width, int height) const
+{
+	return header + row_bytes(width) * height;
+}
+
+bool RawFormat::is_present(qint64 bytes, qint64 available)
+{
+	return bytes <= missing_factor * qMax< qint64 >(0, available) + missing_bytes;
+}
+
+int RawFormat::samples(qint64 bytes, int width) const
+{
+	if(bytes >= packed_bytes(width))
+		return width;
+	if(bytes <= 0)
+		return 0;
+	return (int)qMin< qint64 >(width, bytes / group_bytes() * group());
+}
+
+QString RawFormat::name() const
+{
+	if(packing == MIPI)
+		return QString("raw%1").arg(bits);
+	return QString(endian == BIG? "be%1" : "le%1").arg(bits);
+}
+
+RawFormat RawFormat::from_name(const QString &value, bool *ok)
+{
+	RawFormat res;
+	QRegExp plain("^(le|be)(\\d+)$", Qt::CaseInsensitive);
+	QRegExp mipi("^raw(10|12|14)$", Qt::CaseInsensitive);
+
+	bool known = true;
+	if(plain.indexIn(value) >= 0){
+		res.endian = plain.cap(1).toLower() == "be"? BIG : LITTLE;
+		res.bits = plain.cap(2).toInt();
+		known = res.is_valid();
+	}else if(mipi.indexIn(value) >= 0){
+		res.packing = MIPI;
+		res.bits = mipi.cap(1).toInt();
+	}else{
+		known = false;
+	}
+	if(!known)
+		res = RawFormat();
+	if(ok)
+		*ok = known;
+	return res;
+}
+
+bool RawFormat::operator==(const RawFormat &other) const
+{
+	return bits == other.bits && packing == other.packing && endian == other.endian
+			&& header == other.header && stride == other.stride;
+}
+
+bool RawFormat::operator!=(const RawFormat &other) const
+{
+	return !(*this == other);
+}
+
+/////////////////////////////////
+
+namespace unpack{
+
+/// 16-bit little endian samples without mask are copied as is
+static void copy_le16(const uchar* src, ushort* dst, int count, ushort)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	memcpy(dst, src, count * sizeof(ushort));
+#else
+	for(int i = 0; i < count; i++){
+		dst[i] = src[2 * i] | (src[2 * i + 1] << 8);
+	}
+#endif
+}
+
+/// samples [j, count) of plain row
+template< bool BIG >
+static void plain_scalar(const uchar* src, ushort* dst, int j, int count, ushort mask)
+{
+	for(; j < count; ++j){
+		const uchar* s = src + 2 * j;
+		dst[j] = (BIG? (s[0] << 8) | s[1] : s[0] | (s[1] << 8)) & mask;
+	}
+}
+
+template< bool BIG >
+static void plain_row(const uchar* src, ushort* dst, int count, ushort mask)
+{
+	plain_scalar< BIG >(src, dst, 0, count, mask);
+}
+
+/////////////////////////////////
+/// MIPI CSI-2: group of high bytes of samples, then low bits of the same samples from bit 0
+
+template< int BITS >
+struct Mipi;
+
+/// 4 samples in 5 bytes
+template<>
+struct Mipi< 10 >{
+	enum{ GROUP = 4, BYTES = 5 };
+	static inline void group(const uchar* b, ushort* d){
+		for(int k = 0; k < 4; ++k)
+			d[k] = (b[k] << 2) | ((b[4] >> (2 * k)) & 3);
+	}
+};
+
+/// 2 samples in 3 bytes
+template<>
+struct Mipi< 12 >{
+	enum{ GROUP = 2, BYTES = 3 };
+	static inline void group(const uchar* b, ushort* d){
+		d[0] = (b[0] << 4) | (b[2] & 0xf);
+		d[1] = (b[1] << 4) | (b[2] >> 4);
+	}
+};
+
+/// 4 samples in 7 bytes
+template<>
+struct Mipi< 14 >{
+	enum{ GROUP = 4, BYTES = 7 };
+	static inline void group(const uchar* b, ushort* d){
+		const uint low = b[4] | (b[5] << 8) | (b[6] << 16);
+		for(int k = 0; k < 4; ++k)
+			d[k] = (b[k] << 6) | ((low >> (6 * k)) & 0x3f);
+	}
+};
+
+/// samples [j, count) of MIPI row, j is multiple of group. incomplete last group is read whole
+template< int BITS >
+static void mipi_scalar(const uchar* src, ushort* dst, int j, int count)
+{
+	typedef Mipi< BITS > M;
+	for(; j + M::GROUP <= count; j += M::GROUP){
+		M::group(src + j / M::GROUP * M::BYTES, dst + j);
+	}
+	if(j < count){
+		ushort last[M::GROUP];
+		M::group(src + j / M::GROUP * M::BYTES, last);
+		memcpy(dst + j, last, (count - j) * sizeof(ushort));
+	}
+}
+
+template< int BITS >
+static void mipi_row(const uchar* src, ushort* dst, int count, ushort)
+{
+	mipi_scalar< BITS >(src, dst, 0, count);
+}
+
+#if defined(SIMD_X86)
+
+/////////////////////////////////
+/// sse2: plain samples by 8
+
+template< bool BIG >
+SIMD_TARGET_SSE2
+static int plain_sse2(const uchar* src, ushort* dst, int count, ushort mask)
+{
+	const __m128i m = _mm_set1_epi16((short)mask);
+	int j = 0;
+	for(; j + 8 <= count; j += 8){
+		__m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i* >(src + 2 * j));
+		if(BIG)
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128(reinterpret_cast< __m128i* >(dst + j), _mm_and_si128(v, m));
+	}
+	return j;
+}
+
+template< bool BIG >
+SIMD_TARGET_SSE2
+static void plain_row_sse2(const uchar* src, ushort* dst, int count, ushort mask)
+{
+	plain_scalar< BIG >(src, dst, plain_sse2< BIG >(src, dst, count, mask), count, mask);
+}
+
+/////////////////////////////////
+/// avx2: 16 samples by iteration. for MIPI every lane gets 8 samples from own load of 16 bytes,
+/// so loop stops while the second load is inside of row
+
+template< bool BIG >
+SIMD_TARGET_AVX2
+static int plain_avx2(const uchar* src, ushort* dst, int count, ushort mask)
+{
+	const __m256i m = _mm256_set1_epi16((short)mask);
+	int j = 0;
+	for(; j + 16 <= count; j += 16){
+		__m256i v = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(src + 2 * j));
+		if(BIG)
+			v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(dst + j), _mm256_and_si256(v, m));
+	}
+	return j;
+}
+
+template< bool BIG >
+SIMD_TARGET_AVX2
+static void plain_row_avx2(const uchar* src, ushort* dst, int count, ushort mask)
+{
+	plain_scalar< BIG >(src, dst, plain_avx2< BIG >(src, dst, count, mask), count, mask);
+}
+
+/// 16 bytes from s to low lane, from s + offset to high lane
+SIMD_TARGET_AVX2
+static inline __m256i load_lanes(const uchar* s, int offset)
+{
+	__m128i lo = _mm_loadu_si128(reinterpret_cast< const __m128i* >(s));
+	__m128i hi = _mm_loadu_si128(reinterpret_cast< const __m128i* >(s + offset));
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+/// word is (high byte << 8) | low bits of group: high part is w >> 6,
+/// low bits of sample k are moved to bits 6..7 by multiplication to 1 << (6 - 2k)
+SIMD_TARGET_AVX2
+static int mipi10_avx2(const uchar* src, ushort* dst, int count)
+{
+	const qint64 bytes = (qint64)(count + 3) / 4 * 5;
+	const __m256i order = _mm256_setr_epi8(4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8,
+										   4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8);
+	const __m256i mul = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1);
+	const __m256i mask_hi = _mm256_set1_epi16(0x3fc);
+	const __m256i mask_lo = _mm256_set1_epi16(3);
+
+	int j = 0;
+	for(; j + 16 <= count && (qint64)j / 4 * 5 + 26 <= bytes; j += 16){
+		__m256i w = _mm256_shuffle_epi8(load_lanes(src + j / 4 * 5, 10), order);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(w, 6), mask_hi);
+		__m256i lo = _mm256_and_si256(_mm256_srli_epi16(_mm256_mullo_epi16(w, mul), 6), mask_lo);
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(dst + j), _mm256_or_si256(hi, lo));
+	}
+	return j;
+}
+
+/// word is (high byte << 8) | low bits of pair: odd sample is w >> 4,
+/// even one takes high byte from it and low bits from w
+SIMD_TARGET_AVX2
+static int mipi12_avx2(const uchar* src, ushort* dst, int count)
+{
+	const qint64 bytes = (qint64)(count + 1) / 2 * 3;
+	const __m256i order = _mm256_setr_epi8(2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10,
+										   2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10);
+	const __m256i mask_hi = _mm256_setr_epi16(0xff0, 0xfff, 0xff0, 0xfff, 0xff0, 0xfff, 0xff0, 0xfff,
+											  0xff0, 0xfff, 0xff0, 0xfff, 0xff0, 0xfff, 0xff0, 0xfff);
+	const __m256i mask_lo = _mm256_setr_epi16(0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0);
+
+	int j = 0;
+	for(; j + 16 <= count && (qint64)j / 2 * 3 + 28 <= bytes; j += 16){
+		__m256i w = _mm256_shuffle_epi8(load_lanes(src + j / 2 * 3, 12), order);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(w, 4), mask_hi);
+		__m256i lo = _mm256_and_si256(w, mask_lo);
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(dst + j), _mm256_or_si256(hi, lo));
+	}
+	return j;
+}
+
+/// high byte goes to its own word, low bits of sample k are in pair of bytes of group
+/// shifted right by 8, 6, 4, 10 (high word of multiplication to 1 << (16 - shift))
+SIMD_TARGET_AVX2
+static int mipi14_avx2(const uchar* src, ushort* dst, int count)
+{
+	const qint64 bytes = (qint64)(count + 3) / 4 * 7;
+	const __m256i order_hi = _mm256_setr_epi8(0, -128, 1, -128, 2, -128, 3, -128, 7, -128, 8, -128, 9, -128, 10, -128,
+											  0, -128, 1, -128, 2, -128, 3, -128, 7, -128, 8, -128, 9, -128, 10, -128);
+	const __m256i order_lo = _mm256_setr_epi8(3, 4, 4, 5, 5, 6, 5, 6, 10, 11, 11, 12, 12, 13, 12, 13,
+											  3, 4, 4, 5, 5, 6, 5, 6, 10, 11, 11, 12, 12, 13, 12, 13);
+	const __m256i mul = _mm256_setr_epi16(256, 1024, 4096, 64, 256, 1024, 4096, 64,
+										  256, 1024, 4096, 64, 256, 1024, 4096, 64);
+	const __m256i mask_lo = _mm256_set1_epi16(0x3f);
+
+	int j = 0;
+	for(; j + 16 <= count && (qint64)j / 4 * 7 + 30 <= bytes; j += 16){
+		__m256i v = load_lanes(src + j / 4 * 7, 14);
+		__m256i hi = _mm256_slli_epi16(_mm256_shuffle_epi8(v, order_hi), 6);
+		__m256i lo = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(v, order_lo), mul), mask_lo);
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(dst + j), _mm256_or_si256(hi, lo));
+	}
+	return j;
+}
+
+SIMD_TARGET_AVX2
+static void mipi10_row_avx2(const uchar* src, ushort* dst, int count, ushort)
+{
+	mipi_scalar< 10 >(src, dst, mipi10_avx2(src, dst, count), count);
+}
+
+SIMD_TARGET_AVX2
+static void mipi12_row_avx2(const uchar* src, ushort* dst, int count, ushort)
+{
+	mipi_scalar< 12 >(src, dst, mipi12_avx2(src, dst, count), count);
+}
+
+SIMD_TARGET_AVX2
+static void mipi14_row_avx2(const uchar* src, ushort* dst, int count, ushort)
+{
+	mipi_scalar< 14 >(src, dst, mipi14_avx2(src, dst, count), count);
+}
+
+#endif
+
+Unpacker::Unpacker(const RawFormat &format, simd::LEVEL level)
+	: m_func(copy_le16)
+	, m_mask(0xffff)
+{
+	level = qMin(level, simd::level());
+#if !defined(SIMD_X86)
+	level = simd::SCALAR;
+#endif
+	const bool avx2 = level >= simd::AVX2;
+
+	if(format.packing == RawFormat::MIPI){
+		switch (format.bits) {
+			case 10:
+				m_func = mipi_row< 10 >;
+				break;
+			case 12:
+				m_func = mipi_row< 12 >;
+				break;
+			case 14:
+				m_func = mipi_row< 14 >;
+				break;
+			default:
+				break;
+		}
+#if defined(SIMD_X86)
+		/// byte shuffle is needed, sse2 level uses scalar code
+		if(avx2 && format.bits == 10)
+			m_func = mipi10_row_avx2;
+		if(avx2 && format.bits == 12)
+			m_func = mipi12_row_avx2;
+		if(avx2 && format.bits == 14)
+			m_func = mipi14_row_avx2;
+#endif
+		return;
+	}
+
+	m_mask = (ushort)((1 << qBound(8, format.bits, 16)) - 1);
+	const bool big = format.endian == RawFormat::BIG;
+	if(!big && m_mask == 0xffff)
+		return;
+
+	m_func = big? plain_row< true > : plain_row< false >;
+#if defined(SIMD_X86)
+	if(level >= simd::SSE2)
+		m_func = big? plain_row_sse2< true > : plain_row_sse2< false >;
+	if(avx2)
+		m_func = big? plain_row_avx2< true > : plain_row_avx2< false >;
+#endif
+}
+
+}
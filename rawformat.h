@@ -0,0 +1,118 @@
+#ifndef RAWFORMAT_H
+#define RAWFORMAT_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "demosaic_simd.h"
+
+///////////////////////////////////////////////
+/// \brief The RawFormat struct
+/// layout of samples in raw file: bit depth, packing, order of bytes, header of frame and stride of rows.
+/// default is 16-bit little endian samples without padding
+///
+
+struct RawFormat{
+	enum PACKING{
+		PLAIN,		/// sample in 16 bits, upper bits over depth are cleared
+		MIPI		/// MIPI CSI-2 RAW10/RAW12/RAW14: high 8 bits of every sample of group, then low bits of group
+	};
+	enum ENDIAN{
+		LITTLE,
+		BIG			/// for PLAIN only
+	};
+
+	int bits;			/// 8..16 for PLAIN, 10, 12 or 14 for MIPI
+	PACKING packing;
+	ENDIAN endian;
+	qint64 header;		/// bytes before payload of every frame (after width and height of RAW_TYPE_1)
+	qint64 stride;		/// bytes from row to row, 0 - rows without padding
+
+	RawFormat();
+
+	bool is_valid() const;
+	/**
+	 * @brief group
+	 * samples of group of packing (bytes of group are read whole)
+	 * @return
+	 */
+	int group() const;
+	int group_bytes() const;
+	/**
+	 * @brief packed_bytes
+	 * bytes of count samples, last group is whole
+	 * @param count
+	 * @return
+	 */
+	qint64 packed_bytes(int count) const;
+	/// bytes from row to row
+	qint64 row_bytes(int width) const;
+	/// header and rows of frame
+	qint64 frame_bytes(int width, int height) const;
+	/**
+	 * @brief is_present
+	 * frame of size from header is read only if most of it is in file (tail of short last frame is zero),
+	 * so garbage header does not allocate memory far over file
+	 * @param bytes - size of frame from header
+	 * @param available - bytes of file after begin of frame
+	 * @return
+	 */
+	static bool is_present(qint64 bytes, qint64 available);
+	/**
+	 * @brief samples
+	 * samples of row which are whole in bytes (for truncated stream), not more than width
+	 * @param bytes
+	 * @param width
+	 * @return
+	 */
+	int samples(qint64 bytes, int width) const;
+
+	/**
+	 * @brief name
+	 * le16, be16, le12 (12 bits in 16), raw10, raw12, raw14 (MIPI); header and stride are not in name
+	 * @return
+	 */
+	QString name() const;
+	/**
+	 * @brief from_name
+	 * @param value - see name()
+	 * @param ok - false for unknown name (result is default format)
+	 * @return
+	 */
+	static RawFormat from_name(const QString& value, bool* ok = 0);
+
+	bool operator== (const RawFormat& other) const;
+	bool operator!= (const RawFormat& other) const;
+};
+
+namespace unpack{
+
+/**
+ * @brief The Unpacker class
+ * kernel of row of format, selected once by format and instruction set:
+ * MIPI groups are spread by byte shuffle of avx2 (16 samples by iteration),
+ * plain samples are swapped and masked by sse2/avx2; tail is unpacked by scalar code
+ */
+class Unpacker{
+public:
+	Unpacker(const RawFormat& format, simd::LEVEL level);
+	/**
+	 * @brief operator ()
+	 * count samples of row to host order
+	 * @param src - row in file, format.packed_bytes(count) bytes are read
+	 * @param dst
+	 * @param count
+	 */
+	void operator()(const uchar* src, ushort* dst, int count) const{
+		m_func(src, dst, count, m_mask);
+	}
+
+private:
+	typedef void (*Func)(const uchar* src, ushort* dst, int count, ushort mask);
+	Func m_func;
+	ushort m_mask;
+};
+
+}
+
+#endif // RAWFORMAT_H
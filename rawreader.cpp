@@ -1,7 +1,16 @@
 #include "rawreader.h"
+#include "framecache.h"
 
 #include <QFile>
 #include <QRegExp>
+#include <QtEndian>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QDateTime>
+
+#include <string.h>
+#include <limits.h>
 
 /////////////////////////////////
 /// \brief for set alpha in uint
@@ -10,32 +19,85 @@
 #define MAX_UCHAR				(255)
 
 /////////////////////////////////
-/// \brief minFast
-/// get min value with logic operations
-/// \param a
-/// \param b
-/// \return
-inline int minFast(int a, int b)
-{
-	int z = a - b;
-	int i = (~(z >> 31)) & 0x1;
-	return a - i * z;
-}
+/// \brief The RowsTask class
+/// band of rows for thread pool
+class RowsTask: public QRunnable{
+public:
+	RowsTask(const std::function< void(int, int) >& func, int y0, int y1, double* time,
+			 Trace* trace, const char* name, const QAtomicInt* cancel)
+		: m_func(func)
+		, m_y0(y0)
+		, m_y1(y1)
+		, m_time(time)
+		, m_trace(trace)
+		, m_name(name)
+		, m_cancel(cancel)
+	{
+	}
+	virtual void run(){
+		qint64 start = m_trace->now();
+		for(int y = m_y0; y < m_y1 && !m_cancel->loadAcquire(); y += RawReader::STRIP_ROWS){
+			m_func(y, qMin(y + (int)RawReader::STRIP_ROWS, m_y1));
+		}
+		qint64 duration = m_trace->now() - start;
+		*m_time = duration / 1e3;
+		m_trace->add(QString("%1 rows %2-%3").arg(m_name).arg(m_y0).arg(m_y1), "thread", start, duration);
+	}
+
+private:
+	const std::function< void(int, int) >& m_func;
+	int m_y0;
+	int m_y1;
+	double* m_time;
+	Trace* m_trace;
+	const char* m_name;
+	const QAtomicInt* m_cancel;
+};
+
+/////////////////////////////////
+/// names of TYPE_DEMOSCALE for trace
+static const char* demoscaling_names[] = { "gray", "simple", "linear", "malvar", "vng", "ahd", "half" };
 
 /////////////////////////////////
 
 const int reg_raw_type = qRegisterMetaType<RawReader::STATE_TYPE>("RawReader::STATE_TYPE");
+const int reg_raw_stats = qRegisterMetaType<RawStats>("RawStats");
+const int reg_frame_info = qRegisterMetaType<FrameInfo>("FrameInfo");
+
+/////////////////////////////////
+
+FrameInfo::FrameInfo()
+	: time_load(0)
+	, time_exec(0)
+	, time_per_mp(0)
+	, cached(false)
+{
+}
 
 /////////////////////////////////
 
 RawReader::RawReader()
-	: m_width(0)
-	, m_height(0)
-	, m_shift(4)
+	: m_raw_type(RAW_TYPE_NONE)
 	, m_lshift(0)
-	, m_raw_type(RAW_TYPE_NONE)
+	, m_auto_shift(false)
+	, m_width(0)
+	, m_height(0)
+	, m_frame(0)
+	, m_frame_count(0)
+	, m_stream_memory(64)
 	, m_demoscaling(GRAY)
+	, m_pattern(cfa::GRBG)
+	, m_simd_level(simd::level())
+	, m_thread_count(QThread::idealThreadCount())
+	, m_time_per_mp(0)
+	, m_incremental(false)
+	, m_bayer_version(0)
+	, m_rgb_valid(false)
 {
+	m_curve.set_shift(4);
+	if(m_thread_count < 1)
+		m_thread_count = 1;
+	m_pool.setMaxThreadCount(m_thread_count);
 }
 
 RawReader::~RawReader()
@@ -47,37 +109,83 @@ bool RawReader::set_bayer_data(const QByteArray &data)
 	if(data.isNull())
 		return false;
 
-	QDataStream stream(data);
-	stream.setByteOrder(QDataStream::LittleEndian);
+	return set_bayer_data(reinterpret_cast< const uchar* >(data.constData()), data.size());
+}
+
+bool RawReader::set_bayer_data(const uchar *data, qint64 size)
+{
+	if(!data || size <= 0)
+		return false;
+
+	/// pages of mapped file are read here, so ingest includes reading from disk
+	ScopedTimer timer(&m_trace, "ingest");
+
+	qint64 offset = 0;
 
 	switch (m_raw_type) {
 		case RAW_TYPE_NONE:
 		case RAW_TYPE_1:
-			stream >> m_width;
-			stream >> m_height;
+			if(size < 2 * (qint64)sizeof(qint32))
+				return false;
+			m_width = qFromLittleEndian< qint32 >(data);
+			m_height = qFromLittleEndian< qint32 >(data + sizeof(qint32));
+			offset = 2 * sizeof(qint32);
 			break;
 		default:
 			break;
 	}
+	offset += m_format.header;
 
-	if(!m_width || !m_height || qAbs(m_width) > 0xffffff || qAbs(m_height) > 0xffffff)
+	if(!m_format.is_valid() || m_width <= 0 || m_height <= 0 || m_width > 0xffffff || m_height > 0xffffff)
 		return false;
+	/// header which is not of this file (garbage or other format) is not zero-filled up to its size
+	if(!RawFormat::is_present(m_format.frame_bytes(m_width, m_height) - m_format.header, size - offset)){
+		emit log_message(WARNING, QString("frame %1x%2 is much larger than file").arg(m_width).arg(m_height));
+		return false;
+	}
 
-	m_bayer = Mat< ushort >(m_height, m_width);
-	m_tmp = Mat< ushort >(m_height, m_width);
-
-	for(int i = 0; i < m_height; i++){
-		for(int j = 0; j < m_width; j++){
-			uchar ch1, ch2;
-			stream >> ch1 >> ch2;
-			ushort val = (ch1) | (ch2 << 8);
-			m_bayer.at(i, j) = val;
-		}
+	/// buffer of previous frame of the same size is reused
+	m_initial.create(m_height, m_width, cfa::HALO);
+	m_bayer_version++;
+	if(m_initial.empty()){
+		emit log_message(ERROR, QString("not enough memory for frame %1x%2").arg(m_width).arg(m_height));
+		return false;
 	}
 
-	m_initial = m_bayer;
+	/// payload is unpacked in place by strips of rows (padding of rows is skipped); tail of short stream is zero.
+	/// statistics of every strip are collected from rows just written (they are in cache) and joined at the end of strip
+	const unpack::Unpacker unpacker(m_format, m_simd_level);
+	const qint64 row_bytes = m_format.row_bytes(m_width);
+	const uchar *src = data + offset;
+	const qint64 avail = size - offset;
+
+	m_stats.reset(m_format.bits);
+	QMutex mutex;
+
+	parallel_rows("ingest", 0, m_height, [&](int y0, int y1){
+		RawStats stats;
+		stats.reset(m_format.bits);
+		for(int i = y0; i < y1; i++){
+			const qint64 rest = avail - row_bytes * i;
+			const int count = rest > 0? m_format.samples(rest, m_width) : 0;
+			ushort *dst = m_initial.at(i);
+			if(count > 0)
+				unpacker(src + row_bytes * i, dst, count);
+			if(count < m_width)
+				memset(dst + count, 0, (m_width - count) * sizeof(ushort));
+			stats.add_row(dst, count, i);
+		}
+		QMutexLocker lock(&mutex);
+		m_stats.merge(stats);
+	});
 
-	left_shift();
+	/// rows of canceled ingest are not read, frame is read again by next job
+	if(is_canceled()){
+		clear_bayer();
+		return false;
+	}
+	/// border is mirrored once here, kernels read it as pixels of frame
+	m_initial.fill_halo();
 
 	return true;
 }
@@ -87,50 +195,342 @@ bool RawReader::set_bayer_data(const QImage &image)
 	if(image.isNull())
 		return false;
 
+	ScopedTimer timer(&m_trace, "ingest");
+
 	m_width = image.width();
 	m_height = image.height();
 
-	m_bayer = Mat< ushort >(m_height, m_width);
-	m_tmp = Mat< ushort >(m_height, m_width);
+	m_initial.create(m_height, m_width, cfa::HALO);
+	m_bayer_version++;
+	if(m_initial.empty())
+		return false;
+	m_stats.reset(8);
 
 	for(int i = 0; i < m_height; i++){
 		const QRgb* sl = reinterpret_cast< const QRgb* >(image.scanLine(i));
-		ushort *d = m_bayer.at(i);
+		ushort *d = m_initial.at(i);
 		for(int j = 0; j < m_width; j++){
 			d[j] = (sl[j] & 0xff);
 		}
+		m_stats.add_row(d, m_width, i);
+	}
+	m_initial.fill_halo();
+
+	return true;
+}
+
+bool RawReader::open_file(const QString &fileName)
+{
+	return open_image(fileName) || open_raw(fileName);
+}
+
+bool RawReader::open_raw(const QString &fileName)
+{
+	if(!fileName.contains(QRegExp("\\.raw$|\\.bin$", Qt::CaseInsensitive)))
+		return false;
+
+	QFile fl(fileName);
+
+	bool res = false;
+	uchar *ptr = 0;
+	QByteArray data;
+	qint64 offset = 0, size = 0;
+
+	{
+		ScopedTimer timer(&m_trace, "read");
+
+		if(!fl.open(QIODevice::ReadOnly) || !find_frame(fl, offset, size))
+			return false;
+
+		/// file is mapped and decoded in place, without intermediate copy
+		ptr = fl.map(offset, size);
+		if(!ptr && fl.seek(offset))
+			data = fl.read(size);
+	}
+
+	if(m_raw_type == RAW_TYPE_1 && m_index.has_checksum() && m_frame < m_index.size()){
+		const uchar* bytes = ptr? ptr : reinterpret_cast< const uchar* >(data.constData());
+		const qint64 header = 2 * sizeof(qint32);
+		if(bytes && size > header
+				&& FrameIndex::adler32(bytes + header, size - header) != m_index.at(m_frame).checksum)
+			emit log_message(WARNING, QString("checksum of frame %1 is wrong").arg(m_frame));
+	}
+
+	if(ptr){
+		res = set_bayer_data(ptr, size);
+		fl.unmap(ptr);
+	}else{
+		res = set_bayer_data(data);
+	}
+	fl.close();
+
+	return res;
+}
+
+bool RawReader::stream_raw(const QString &fileName, StreamSink *sink)
+{
+	if(!sink || !fileName.contains(QRegExp("\\.raw$|\\.bin$", Qt::CaseInsensitive)))
+		return false;
+
+	QFile fl(fileName);
+	qint64 offset = 0, size = 0;
+	if(!fl.open(QIODevice::ReadOnly) || !find_frame(fl, offset, size))
+		return false;
+
+	/// header of frame is read here, payload by windows of strips
+	qint64 payload = offset;
+	if(m_raw_type != RAW_TYPE_2){
+		uchar header[2 * sizeof(qint32)];
+		if(!fl.seek(offset) || fl.read(reinterpret_cast< char* >(header), sizeof(header)) != (qint64)sizeof(header))
+			return false;
+		m_width = qFromLittleEndian< qint32 >(header);
+		m_height = qFromLittleEndian< qint32 >(header + sizeof(qint32));
+		payload += sizeof(header);
+	}
+	payload += m_format.header;
+	const qint64 end = offset + size;
+
+	if(!m_format.is_valid() || m_width <= 0 || m_height <= 0 || m_width > 0xffffff || m_height > 0xffffff)
+		return false;
+	if(!RawFormat::is_present(m_format.frame_bytes(m_width, m_height) - m_format.header, end - payload)){
+		emit log_message(WARNING, QString("frame %1x%2 is much larger than file").arg(m_width).arg(m_height));
+		return false;
+	}
+
+	const int width = m_width, height = m_height;
+	const bool half = m_demoscaling == HALF;
+	if(!sink->begin(half? width / 2 : width, half? height / 2 : height))
+		return false;
+
+	/// statistics are not known before the first strip is written: shift is as set
+	m_stats.reset(0);
+	m_curve.update();
+
+	const qint64 row_bytes = m_format.row_bytes(width);
+	const unpack::Unpacker unpacker(m_format, m_simd_level);
+	const int rows = stream_rows(width);
+	/// strip is not a frame, cache of demoscaling is not used
+	const bool incremental = m_incremental;
+	m_incremental = false;
+
+	bool res = true;
+	int strips = 0;
+	for(int y0 = 0; y0 < height && res; ){
+		int y1 = qMin(height, y0 + rows);
+		if(height - y1 < MIN_STREAM_ROWS)
+			y1 = height;
+		/// rows of file for strip and its halo: rows of halo are neighbours of strip or mirror at border of frame
+		const int w0 = qMax(0, y0 - cfa::HALO), w1 = qMin(height, y1 + cfa::HALO);
+		const qint64 from = payload + w0 * row_bytes;
+		const qint64 bytes = qMin(end, payload + w1 * row_bytes) - from;
+
+		uchar *ptr = 0;
+		QByteArray data;
+		{
+			ScopedTimer timer(&m_trace, "read");
+			if(bytes > 0){
+				ptr = fl.map(from, bytes);
+				if(!ptr && fl.seek(from))
+					data = fl.read(bytes);
+			}
+		}
+		const uchar* src = ptr? ptr : reinterpret_cast< const uchar* >(data.constData());
+		const qint64 avail = ptr? bytes : data.size();
+
+		{
+			ScopedTimer timer(&m_trace, "ingest");
+			m_initial.create(y1 - y0, width, cfa::HALO);
+			m_bayer_version++;
+			if(m_initial.empty()){
+				if(ptr)
+					fl.unmap(ptr);
+				res = false;
+				break;
+			}
+			for(int r = -cfa::HALO; r < y1 - y0 + cfa::HALO; ++r){
+				const qint64 at = (Mat< ushort >::mirror(y0 + r, height) - w0) * row_bytes;
+				/// tail of short file is zero
+				const int count = src && at < avail? m_format.samples(avail - at, width) : 0;
+				ushort* d = m_initial.at(r);
+				if(count)
+					unpacker(src + at, d, count);
+				if(count < width)
+					memset(d + count, 0, (width - count) * sizeof(ushort));
+				m_initial.fill_halo_row(r);
+			}
+		}
+		if(ptr)
+			fl.unmap(ptr);
+
+		/// strip is computed as frame of its rows (y0 is even, so pattern is the same), messages of strips are not shown
+		m_width = width;
+		m_height = y1 - y0;
+		bool blocked = blockSignals(true);
+		demoscaling_direct();
+		blockSignals(blocked);
+		strips++;
+
+		/// canceled or without memory for image of strip
+		if(is_canceled() || m_image.isNull()){
+			res = false;
+		}else{
+			ScopedTimer timer(&m_trace, "write");
+			res = sink->write(m_image);
+		}
+		y0 = y1;
 	}
-	m_initial = m_bayer;
+	m_incremental = incremental;
+
+	/// bayer and output hold the last strip only, size is of frame
+	m_initial.clear();
+	m_bayer_version++;
+	m_image = QImage();
+	m_width = width;
+	m_height = height;
+
+	res = sink->end() && res;
+	if(res)
+		emit log_message(OK, QString("end %1 demoscaling of %2x%3 by %4 strips of %5 rows")
+						 .arg(demoscaling_names[m_demoscaling]).arg(width).arg(height).arg(strips).arg(rows));
+	return res;
+}
+
+void RawReader::set_stream_memory(int megabytes)
+{
+	m_stream_memory = qMax(1, megabytes);
+}
+
+int RawReader::stream_memory() const
+{
+	return m_stream_memory;
+}
 
-	left_shift();
+int RawReader::stream_rows(int width) const
+{
+	/// window of file, source with halo and ARGB32 output by row
+	const qint64 per_row = m_format.row_bytes(width) + (qint64)(width + 2 * cfa::HALO) * sizeof(ushort)
+			+ (qint64)width * sizeof(QRgb);
+	const qint64 rows = ((qint64)m_stream_memory << 20) / qMax< qint64 >(1, per_row);
+	return (int)qBound< qint64 >(MIN_STREAM_ROWS, rows, INT_MAX / 2) & ~1;
+}
 
+bool RawReader::find_frame(QFile &fl, qint64 &offset, qint64 &size)
+{
+	offset = 0;
+	size = fl.size();
+	m_frame_count = 1;
+
+	/// sequence of frames without header: only the frame m_frame is read
+	if(m_raw_type == RAW_TYPE_2 && m_width > 0 && m_height > 0){
+		m_frame_count = sequence_length(size, m_width, m_height, m_format);
+		if(m_frame < 0 || m_frame >= m_frame_count){
+			emit log_message(WARNING, QString("frame %1 is out of file (%2 frames)").arg(m_frame).arg(m_frame_count));
+			return false;
+		}
+		const qint64 frame_bytes = m_format.frame_bytes(m_width, m_height);
+		offset = m_frame * frame_bytes;
+		size = qMin(frame_bytes, size - offset);
+	}
+
+	/// stream of frames with headers: frame is found by index (sidecar or one pass over headers)
+	if(m_raw_type == RAW_TYPE_1 && m_index.open(fl.fileName(), m_format)){
+		m_frame_count = m_index.size();
+		if(m_frame < 0 || m_frame >= m_frame_count){
+			emit log_message(WARNING, QString("frame %1 is out of file (%2 frames)").arg(m_frame).arg(m_frame_count));
+			return false;
+		}
+		offset = m_index.at(m_frame).offset;
+		size = m_index.bytes(m_frame);
+	}
 	return true;
 }
 
+void RawReader::set_frame(int index)
+{
+	m_frame = index;
+}
+
+int RawReader::frame() const
+{
+	return m_frame;
+}
+
+int RawReader::frame_count() const
+{
+	return m_frame_count;
+}
+
+void RawReader::set_frame_index(const FrameIndex &index)
+{
+	m_index = index;
+}
+
+const FrameIndex &RawReader::frame_index() const
+{
+	return m_index;
+}
+
+int RawReader::sequence_length(qint64 file_size, int width, int height, const RawFormat &format)
+{
+	if(file_size <= 0 || width <= 0 || height <= 0)
+		return 0;
+	const qint64 frame_bytes = format.frame_bytes(width, height);
+	return (int)qMin< qint64 >(INT_MAX, qMax< qint64 >(1, file_size / frame_bytes));
+}
+
+void RawReader::set_format(const RawFormat &value)
+{
+	m_format = value;
+}
+
+const RawFormat &RawReader::format() const
+{
+	return m_format;
+}
+
+bool RawReader::open_image(const QString &fileName)
+{
+	if(!fileName.contains(QRegExp("\\.jpeg$|\\.jpg$|\\.bmp$|\\.png$", Qt::CaseInsensitive)))
+		return false;
+
+	QImage image;
+	{
+		ScopedTimer timer(&m_trace, "decode");
+		image.load(fileName);
+	}
+
+	set_type(RawReader::RAW_TYPE_NONE);
+
+	m_frame_count = 1;
+	return set_bayer_data(image);
+}
+
 void RawReader::clear_bayer()
 {
-	m_bayer.clear();
 	m_initial.clear();
-	m_tmp.clear();
 	m_width = m_height = 0;
+	m_bayer_version++;
+	m_stats.reset(0);
+	m_rgb.clear();
+	m_rgb_valid = false;
 }
 
 bool RawReader::empty() const
 {
-	return m_bayer.empty();
+	return m_initial.empty();
 }
 
 void RawReader::set_shift(int shift)
 {
 	if(shift <= 0)
 		return;
-	m_shift = shift;
+	m_curve.set_shift(shift);
 }
 
 void RawReader::set_lshift(int value)
 {
-	m_lshift = value;
-	left_shift();
+	/// shift is applied on reading of source in every demoscaling pass
+	m_lshift = qBound(0, value, 16);
 }
 
 int RawReader::lshift() const
@@ -143,8 +543,296 @@ void RawReader::set_demoscaling(TYPE_DEMOSCALE value)
 	m_demoscaling = value;
 }
 
-void RawReader::compute()
+void RawReader::set_pattern(cfa::PATTERN value)
+{
+	m_pattern = value;
+}
+
+cfa::PATTERN RawReader::pattern() const
+{
+	return m_pattern;
+}
+
+void RawReader::set_color(const ColorCorrection &value)
+{
+	m_color = value;
+}
+
+const ColorCorrection &RawReader::color() const
+{
+	return m_color;
+}
+
+void RawReader::set_auto_shift(bool value)
+{
+	m_auto_shift = value;
+}
+
+bool RawReader::auto_shift() const
+{
+	return m_auto_shift;
+}
+
+RawStats RawReader::stats() const
+{
+	RawStats res = m_stats;
+	res.pattern = m_pattern;
+	return res;
+}
+
+const pixel::Correction *RawReader::correction(pixel::Correction &value) const
+{
+	if(m_color.is_identity())
+		return 0;
+	value = m_color.fixed(m_lshift);
+	return &value;
+}
+
+void RawReader::set_simd_level(simd::LEVEL value)
+{
+	m_simd_level = qMin(value, simd::level());
+}
+
+simd::LEVEL RawReader::simd_level() const
+{
+	return m_simd_level;
+}
+
+void RawReader::set_thread_count(int value)
+{
+	if(value < 1)
+		return;
+	m_thread_count = value;
+	m_pool.setMaxThreadCount(m_thread_count);
+}
+
+int RawReader::thread_count() const
+{
+	return m_thread_count;
+}
+
+void RawReader::set_incremental(bool value)
+{
+	m_incremental = value;
+	if(!m_incremental){
+		m_rgb.clear();
+		m_rgb_valid = false;
+	}
+}
+
+bool RawReader::incremental() const
+{
+	return m_incremental;
+}
+
+void RawReader::invalidate()
+{
+	m_rgb_valid = false;
+}
+
+bool RawReader::is_cached() const
+{
+	if(!m_incremental || !m_rgb_valid || !rgb16_supported())
+		return false;
+	RgbKey key = { m_bayer_version, m_lshift, m_demoscaling, m_pattern, m_color, m_simd_level };
+	return key == m_rgb_key;
+}
+
+QVector<double> RawReader::thread_times() const
+{
+	return m_thread_times;
+}
+
+double RawReader::time_per_mp() const
+{
+	return m_time_per_mp;
+}
+
+Trace &RawReader::trace()
+{
+	return m_trace;
+}
+
+const Trace &RawReader::trace() const
+{
+	return m_trace;
+}
+
+RawReader::Settings RawReader::settings() const
+{
+	Settings res;
+	res.type = m_raw_type;
+	res.width = m_width;
+	res.height = m_height;
+	res.format = m_format;
+	res.frame = m_frame;
+	res.shift = m_curve.shift();
+	res.auto_shift = m_auto_shift;
+	res.lshift = m_lshift;
+	res.demoscaling = m_demoscaling;
+	res.pattern = m_pattern;
+	res.color = m_color;
+	res.simd_level = m_simd_level;
+	res.threads = m_thread_count;
+	res.curve = m_curve.type();
+	res.gamma = m_curve.gamma();
+	res.log_scale = m_curve.log_scale();
+	res.points = m_curve.points();
+	return res;
+}
+
+void RawReader::apply(const RawReader::Settings &value)
+{
+	set_type(value.type);
+	set_format(value.format);
+	set_frame(value.frame);
+	set_shift(value.shift);
+	set_auto_shift(value.auto_shift);
+	set_lshift(value.lshift);
+	set_demoscaling(value.demoscaling);
+	set_pattern(value.pattern);
+	set_color(value.color);
+	set_simd_level(value.simd_level);
+	if(value.threads != m_thread_count)
+		set_thread_count(value.threads);
+	/// table is rebuilt only if parameters of curve are changed
+	m_curve.set_type(value.curve);
+	m_curve.set_gamma(value.gamma);
+	m_curve.set_log_scale(value.log_scale);
+	m_curve.set_points(value.points);
+}
+
+void RawReader::cancel()
+{
+	m_cancel.storeRelease(1);
+}
+
+void RawReader::clear_cancel()
+{
+	m_cancel.storeRelease(0);
+}
+
+bool RawReader::is_canceled() const
+{
+	return m_cancel.loadAcquire() != 0;
+}
+
+void RawReader::parallel_rows(const char *name, int y0, int y1, const std::function< void (int, int) > &func)
+{
+	int rows = y1 - y0;
+	int bands = qMax(1, qMin(m_thread_count, rows / 2));
+
+	m_thread_times.fill(0, bands);
+
+	if(bands == 1){
+		RowsTask task(func, y0, y1, &m_thread_times[0], &m_trace, name, &m_cancel);
+		task.run();
+		return;
+	}
+
+	/// bands begin from even row, so every band has whole bayer quads
+	for(int k = 0; k < bands; ++k){
+		int b0 = k? (y0 + rows * k / bands) & ~1 : y0;
+		int b1 = k < bands - 1? (y0 + rows * (k + 1) / bands) & ~1 : y1;
+		RowsTask* task = new RowsTask(func, b0, b1, &m_thread_times[k], &m_trace, name, &m_cancel);
+		task->setAutoDelete(true);
+		m_pool.start(task);
+	}
+	m_pool.waitForDone();
+}
+
+bool RawReader::compute()
 {
+	QElapsedTimer timer;
+	timer.start();
+
+	{
+		/// table is rebuilt only if shift or curve is changed
+		ScopedTimer timer(&m_trace, "curve");
+		if(m_auto_shift && m_stats.is_valid())
+			m_curve.set_shift(m_stats.auto_shift(m_lshift));
+		m_curve.update();
+	}
+
+	if(m_incremental && rgb16_supported()){
+		RgbKey key = { m_bayer_version, m_lshift, m_demoscaling, m_pattern, m_color, m_simd_level };
+		if(!m_rgb_valid || !(key == m_rgb_key)){
+			ScopedTimer stage(&m_trace, demoscaling_names[m_demoscaling]);
+			m_rgb_valid = false;
+			demoscaling_rgb16();
+			if(is_canceled())
+				return false;
+			m_rgb_key = key;
+			m_rgb_valid = true;
+		}else{
+			emit log_message(OK, QString("%1 demoscaling is cached, only tone mapping").arg(demoscaling_names[m_demoscaling]));
+		}
+
+		ScopedTimer stage(&m_trace, "tone");
+		tone_map();
+	}else{
+		demoscaling_direct();
+	}
+
+	/// canceled or without memory for image
+	if(is_canceled() || m_image.isNull())
+		return false;
+
+	double mp = (double)m_width * m_height / 1e6;
+	m_time_per_mp = mp > 0? timer.nsecsElapsed() / 1e6 / mp : 0;
+	return true;
+}
+
+QImage RawReader::compute_tile(const QRect &rect, RawReader &context)
+{
+	const QRect frame(0, 0, m_width, m_height);
+	const QRect roi = rect & frame;
+	if(m_initial.empty() || roi.isEmpty() || m_demoscaling == HALF || &context == this)
+		return QImage();
+
+	ScopedTimer timer(&m_trace, "tile");
+
+	/// parameters of frame; shift is the used one, context has no statistics
+	Settings settings = this->settings();
+	settings.auto_shift = false;
+	context.apply(settings);
+	context.set_incremental(false);
+	context.m_curve.update();
+
+	/// source with halo. origin is even, so pattern is the same; size is even if frame allows
+	int x0 = qMax(0, roi.left() - TILE_HALO) & ~1;
+	int y0 = qMax(0, roi.top() - TILE_HALO) & ~1;
+	int x1 = qMin(m_width, (roi.right() + 1 + TILE_HALO + 1) & ~1);
+	int y1 = qMin(m_height, (roi.bottom() + 1 + TILE_HALO + 1) & ~1);
+
+	/// source is the frame of context (buffer of previous tile of the same size is reused)
+	context.m_initial.create(y1 - y0, x1 - x0, cfa::HALO);
+	context.m_bayer_version++;
+	if(context.m_initial.empty())
+		return QImage();
+	context.m_width = x1 - x0;
+	context.m_height = y1 - y0;
+	for(int i = y0; i < y1; ++i){
+		memcpy(context.m_initial.at(i - y0), m_initial.at(i) + x0, (x1 - x0) * sizeof(ushort));
+	}
+	/// halo inside of frame is not its neighbours, but it only changes pixels of TILE_HALO
+	context.m_initial.fill_halo();
+
+	/// messages of tiles are not shown
+	if(!context.prepare_image())
+		return QImage();
+	bool blocked = context.blockSignals(true);
+	context.m_image.fill(0);
+	context.demoscaling_direct();
+	context.blockSignals(blocked);
+
+	return context.m_image.copy(roi.translated(-x0, -y0));
+}
+
+void RawReader::demoscaling_direct()
+{
+	ScopedTimer stage(&m_trace, demoscaling_names[m_demoscaling]);
+
 	switch (m_demoscaling) {
 		default:
 		case GRAY:
@@ -154,7 +842,28 @@ void RawReader::compute()
 			demoscaling();
 			break;
 		case LINEAR:
-			demoscaling_linear();
+			/// reference version knows only GRBG without correction, others use scalar path of simd::linear
+			if(simd::linear_supported(m_width, m_height) && (m_simd_level != simd::SCALAR || !is_reference_linear()))
+				demoscaling_linear_simd();
+			else if(is_reference_linear())
+				demoscaling_linear();
+			else{
+				demoscaling();
+				/// after message of simple demoscaling, so it stays in status
+				emit log_message(WARNING, "frame is too small for linear, simple demoscaling is used");
+			}
+			break;
+		case MALVAR:
+			demoscaling_hq(hq::MALVAR);
+			break;
+		case VNG:
+			demoscaling_hq(hq::VNG);
+			break;
+		case AHD:
+			demoscaling_hq(hq::AHD);
+			break;
+		case HALF:
+			demoscaling_half();
 			break;
 	}
 }
@@ -174,6 +883,7 @@ void RawReader::set_size(int w, int h)
 	if(m_raw_type == RAW_TYPE_2){
 		m_width = w;
 		m_height = h;
+		m_bayer_version++;
 	}else{
 		emit log_message(WARNING, "size not set. different type");
 	}
@@ -184,9 +894,64 @@ const QImage &RawReader::image() const
 	return m_image;
 }
 
+void RawReader::swap_image(QImage &other)
+{
+	m_image.swap(other);
+}
+
+bool RawReader::prepare_image()
+{
+	return prepare_image(m_width, m_height);
+}
+
+bool RawReader::prepare_image(int width, int height)
+{
+	/// buffer is reused if nobody else holds it (e.g. previous frame is released by the UI),
+	/// otherwise writing to it would detach with a full copy
+	if(m_image.width() != width || m_image.height() != height || m_image.format() != QImage::Format_ARGB32
+			|| !m_image.isDetached()){
+		/// new buffer is taken from pool and returned to it when the last copy of image is released
+		const int bpl = width * sizeof(QRgb);
+		void* bits = BufferPool::instance().acquire(qMax< size_t >(1, (size_t)bpl * height));
+		if(!bits){
+			m_image = QImage();
+			emit log_message(ERROR, QString("not enough memory for image %1x%2").arg(width).arg(height));
+			return false;
+		}
+		m_image = QImage(static_cast< uchar* >(bits), width, height, bpl, QImage::Format_ARGB32,
+						 BufferPool::release_image, bits);
+	}
+	return true;
+}
+
 int RawReader::shift() const
 {
-	return m_shift;
+	return m_curve.shift();
+}
+
+void RawReader::set_curve(ToneCurve::TYPE type)
+{
+	m_curve.set_type(type);
+}
+
+void RawReader::set_curve_gamma(double value)
+{
+	m_curve.set_gamma(value);
+}
+
+void RawReader::set_curve_log_scale(double value)
+{
+	m_curve.set_log_scale(value);
+}
+
+void RawReader::set_curve_points(const QVector<QPointF> &points)
+{
+	m_curve.set_points(points);
+}
+
+const ToneCurve &RawReader::curve() const
+{
+	return m_curve;
 }
 
 void RawReader::set_type(RawReader::RAW_TYPE type)
@@ -199,381 +964,588 @@ RawReader::RAW_TYPE RawReader::type() const
 	return m_raw_type;
 }
 
-void RawReader::left_shift()
-{
-	for(int i = 0; i < m_height; i++){
-		ushort *d = m_bayer.at(i);
-		ushort *din = m_initial.at(i);
-		for(int j = 0; j < m_width; j++){
-			d[j] = din[j] << m_lshift;
-		}
-	}
-}
-
 void RawReader::demoscaling()
 {
-	if(m_bayer.empty())
+	if(m_initial.empty())
+		return;
+	if(!prepare_image())
 		return;
-	m_image = QImage(m_width, m_height, QImage::Format_ARGB32);
 
-	for(int i = 1; i < m_height - 1; i++){
-		QRgb* sl = reinterpret_cast< QRgb* >(m_image.scanLine(i));
-		for(int j = 1; j < m_width - 1; j++){
-			int red = 0, green = 0, blue = 0;
-			green = getgreen(i, j);
-			blue = getblue(i, j);
-			red = getred(i, j);
-			sl[j] = qRgb(red, green, blue);
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
+
+	const pixel::Tone8 o = { m_curve.lut() };
+	pixel::Correction cc;
+	const pixel::Correction* c = correction(cc);
+
+	parallel_rows("simple", 0, m_height, [&](int y0, int y1){
+		if(c){
+			const pixel::Corrected< pixel::Tone8 > co = { o, cc };
+			demoscaling_rows(co, bits, bpl, y0, y1);
+		}else{
+			demoscaling_rows(o, bits, bpl, y0, y1);
 		}
-	}
+	});
+
 	emit log_message(OK, "end slow demoscaling");
 }
 
-int RawReader::getblue(int i, int j)
-{
-	int val = 0;
-	switch (j % 2) {
-		case 0:
-			switch (i % 2) {
-				case 1:
-					val = m_bayer(i, j);
-					break;
-				case 0:
-					val += m_bayer(i-1, j);
-					val += m_bayer(i+1, j);
-					val >>= 1;
-				default:
-					break;
-			}
-			break;
-		case 1:
-			val = 0;
-			switch (i % 2) {
-				case 1:
-					val += m_bayer(i, j-1);
-					val += m_bayer(i, j+1);
-					val >>= 1;
-					break;
-				case 0:
-					val += m_bayer(i-1, j-1);
-					val += m_bayer(i-1, j+1);
-					val += m_bayer(i+1, j-1);
-					val += m_bayer(i+1, j+1);
-					val >>= 2;
-				default:
-					break;
-			}
+template< typename O >
+void RawReader::demoscaling_rows(const O &o, uchar *bits, int bpl, int y0, int y1)
+{
+	switch (m_pattern) {
+		case cfa::RGGB:
+			demoscaling_rows_cfa< cfa::RGGB >(o, bits, bpl, y0, y1);
 			break;
-		default:
+		case cfa::BGGR:
+			demoscaling_rows_cfa< cfa::BGGR >(o, bits, bpl, y0, y1);
 			break;
-	}
-	return minFast(MAX_UCHAR, val >> m_shift);
-}
-
-int RawReader::getred(int i, int j)
-{
-	int val = 0;
-	switch (j % 2) {
-		case 0:
-			switch (i % 2) {
-				case 0:
-					val += m_bayer(i, j-1);
-					val += m_bayer(i, j+1);
-					val >>= 1;
-					break;
-				case 1:
-					val += m_bayer(i-1, j-1);
-					val += m_bayer(i-1, j+1);
-					val += m_bayer(i+1, j-1);
-					val += m_bayer(i+1, j+1);
-					val >>= 2;
-					break;
-				default:
-					break;
-			}
+		case cfa::GBRG:
+			demoscaling_rows_cfa< cfa::GBRG >(o, bits, bpl, y0, y1);
 			break;
-		case 1:
+		case cfa::GRBG:
 		default:
-			switch (i % 2) {
-				case 0:
-					val = m_bayer(i, j);
-					break;
-				case 1:
-					val += m_bayer(i-1, j);
-					val += m_bayer(i+1, j);
-					val >>= 1;
-				default:
-					break;
-			}
+			demoscaling_rows_cfa< cfa::GRBG >(o, bits, bpl, y0, y1);
 			break;
 	}
-	return minFast(MAX_UCHAR, val >> m_shift);
-}
-
-int RawReader::getgreen(int i, int j)
-{
-	int val = 0;
-	switch (j % 2) {
-		case 0:
-			switch (i % 2) {
-				case 0:
-					val += m_bayer(i, j);
-					val += m_bayer(i-1, j-1);
-					val += m_bayer(i-1, j+1);
-					val += m_bayer(i+1, j-1);
-					val += m_bayer(i+1, j+1);
-					val /= 5;
-					break;
-				case 1:
-				default:
-					val += m_bayer(i-1, j);
-					val += m_bayer(i, j-1);
-					val += m_bayer(i, j+1);
-					val += m_bayer(i+1, j);
-					val >>= 2;
-					break;
-			}
-			break;
-		case 1:
-		default:
-			switch (i % 2) {
-				case 0:
-					val += m_bayer(i-1, j);
-					val += m_bayer(i, j-1);
-					val += m_bayer(i, j+1);
-					val += m_bayer(i+1, j);
-					val >>= 2;
-					break;
-				case 1:
-				default:
-					val += m_bayer(i, j);
-					val += m_bayer(i-1, j-1);
-					val += m_bayer(i-1, j+1);
-					val += m_bayer(i+1, j-1);
-					val += m_bayer(i+1, j+1);
-					val /= 5;
-					break;
-			}
-			break;
+}
+
+template< int P, typename O >
+void RawReader::demoscaling_rows_cfa(const O &o, uchar *bits, int bpl, int y0, int y1)
+{
+	for(int i = y0; i < y1; i++){
+		typename O::Pixel* sl = reinterpret_cast< typename O::Pixel* >(bits + (qint64)i * bpl);
+		if(i & 1)
+			demoscaling_row< P, 1 >(o, sl, i);
+		else
+			demoscaling_row< P, 0 >(o, sl, i);
+	}
+}
+
+template< int P, int Y, typename O >
+void RawReader::demoscaling_row(const O &o, typename O::Pixel *sl, int i)
+{
+	/// columns by pairs: parity of both is known at compile time, border is in halo
+	int j = 0;
+	for(; j + 1 < m_width; j += 2){
+		sl[j]		= simple_pixel< P, Y, 0 >(o, i, j);
+		sl[j + 1]	= simple_pixel< P, Y, 1 >(o, i, j + 1);
 	}
-	return minFast(MAX_UCHAR, val >> m_shift);
+	if(j < m_width)
+		sl[j] = simple_pixel< P, Y, 0 >(o, i, j);
+}
+
+template< int P, int Y, int X, typename O >
+typename O::Pixel RawReader::simple_pixel(const O &o, int i, int j)
+{
+	int red = 0, green = 0, blue = 0;
+	cfa::interpolate< P, Y, X >([&](int di, int dj){ return bayer(i + di, j + dj); }, red, green, blue);
+	return o(red, green, blue);
 }
 
 void RawReader::demoscaling_linear()
 {
-	if(m_bayer.empty())
+	if(m_initial.empty())
 		return;
 
-	m_tmp = m_bayer;
-
-	m_image = QImage(m_width, m_height, QImage::Format_ARGB32);
-
-	/// green
-	for(int i = 1; i < m_height - 2; i += 2){
-		QRgb* sl0 = reinterpret_cast< QRgb* >(m_image.scanLine(i));
-		QRgb* sl1 = reinterpret_cast< QRgb* >(m_image.scanLine(i + 1));
-		ushort* dm1 = m_tmp.at(i - 1);
-		ushort* d0 = m_tmp.at(i);
-		ushort* dp1 = m_tmp.at(i + 1);
-		ushort* dp2 = m_tmp.at(i + 2);
-		for(int j = 1; j < m_width - 2; j+= 2){
-			int g00 = 0, g01 = 0, g10 = 0, g11 = 0;
-
-			g00 = (dm1[j - 1] + dm1[j + 1] + d0[j] + dp1[j - 1]	+ dp1[j + 1]) / 5;
-			g11 = (d0[j] + d0[j + 2] + dm1[j + 1] + dp2[j] + dp2[j + 2])/5;
-			g01 = (dm1[j + 1] + d0[j] + d0[j + 2] + dp1[j + 1]) >> 2;
-			g10 = (d0[j] + dp1[j - 1] + dp1[j + 1] + dp2[j]) >> 2;
-
-			g00 = minFast(g00 >> m_shift, MAX_UCHAR);
-			g01 = minFast(g01 >> m_shift, MAX_UCHAR);
-			g10 = minFast(g10 >> m_shift, MAX_UCHAR);
-			g11 = minFast(g11 >> m_shift, MAX_UCHAR);
-
-			sl0[j]		= (g00 << 8) | MASK_ALPHAMAX_UCHAR;
-			sl0[j + 1]	= (g01 << 8) | MASK_ALPHAMAX_UCHAR;
-			sl1[j]		= (g10 << 8) | MASK_ALPHAMAX_UCHAR;
-			sl1[j + 1]	= (g11 << 8) | MASK_ALPHAMAX_UCHAR;
-		}
-	}
+	if(!prepare_image())
+		return;
 
-	/// edge green red blue
-	{
-		QRgb* sl0 = reinterpret_cast< QRgb* >(m_image.scanLine(0));				// up image, 0 row
-		QRgb* sl1 = reinterpret_cast< QRgb* >(m_image.scanLine(1));				// up image, 1 row
-		QRgb* slu0 = reinterpret_cast< QRgb* >(m_image.scanLine(m_height - 1));	// down image
-		ushort* d0 = m_tmp.at(0);			// bayer, 0 row
-		ushort* dp1 = m_tmp.at(1);			// bayer, 1 row
-		ushort* dp2 = m_tmp.at(2);			// bayer, 2 row
-
-		ushort* du0 = m_tmp.at(m_height - 1);		// bayer, height-1 row
-		ushort* dup1 = m_tmp.at(m_height - 2);		// bayer, height-2 row
-		for(int j = 1; j < m_width - 2; j+= 2){
-			int g00 = 0, g01 = 0, r00, r01, r10, r11, b00, b01, b10, b11;
-			/// green
-			g00 = (d0[j-1] + d0[j + 1] + dp1[j])/ 3;
-			g01 = (d0[j + 1] + dp1[j] + dp1[j + 2]) / 3;
-			g00 = minFast(g00 >> m_shift, MAX_UCHAR);	g01 = minFast(g01 >> m_shift, MAX_UCHAR);
-			/// red
-			r00 = d0[j];
-			r01 = (d0[j] + d0[j + 2]) >> 1;
-			r00 = minFast(r00 >> m_shift, MAX_UCHAR);	r01 = minFast(r01 >> m_shift, MAX_UCHAR);
-			/// blue
-			b00 = (dp1[j - 1] + dp1[j + 1]) >> 1;
-			b01 = dp1[j + 1];
-			b00 = minFast(b00 >> m_shift, MAX_UCHAR);	b01 = minFast(b01 >> m_shift, MAX_UCHAR);
-
-			sl0[j]		= (b00) | (g00 << 8) | (r00 << 16) | MASK_ALPHAMAX_UCHAR;
-			sl0[j + 1]	= (b01) | (g01 << 8) | (r01 << 16) | MASK_ALPHAMAX_UCHAR;
-
-			//////////////////////////////////
-			r10 = (d0[j] + dp2[j]) >> 1;
-			r11 = (d0[j] + d0[j + 2] + dp2[j] + dp2[j + 2]) >> 2;
-
-			b10 = (dp1[j - 1] + dp1[j + 1]) >> 1;
-			b11 = dp1[j + 1];
-
-			r10 = minFast(r10 >> m_shift, MAX_UCHAR);	r11 = minFast(r11 >> m_shift, MAX_UCHAR);
-			b10 = minFast(b10 >> m_shift, MAX_UCHAR);	b11 = minFast(b11 >> m_shift, MAX_UCHAR);
-
-			sl1[j] |= (b10) | (r10 << 16);
-			sl1[j + 1] |= (b11) | (r11 << 16);
-			//////////////////////////////////
-
-			g00 = (du0[j-1] + du0[j + 1] + dup1[j])/3;
-			g01 = (du0[j] + dup1[j - 1] + dup1[j + 1])/ 3;
-			g00 = minFast(g00 >> m_shift, MAX_UCHAR);	g01 = minFast(g01 >> m_shift, MAX_UCHAR);
-
-			slu0[j]		= (g00 << 8) | MASK_ALPHAMAX_UCHAR;
-			slu0[j + 1]	= (g01 << 8) | MASK_ALPHAMAX_UCHAR;
+	/// frame has mirrored halo, so border is computed by the same formulas as inside
+	for(int i = 0; i < m_height; i++){
+		QRgb* sl = reinterpret_cast< QRgb* >(m_image.scanLine(i));
+		const ushort* dm2 = m_initial.at(i - 2);
+		const ushort* dm1 = m_initial.at(i - 1);
+		const ushort* d0 = m_initial.at(i);
+		const ushort* dp1 = m_initial.at(i + 1);
+		/// rows of red are even, rows of blue are odd
+		const bool blue_row = (i & 1) != 0;
+
+		for(int j = 0; j < m_width; j++){
+			int own, up, down, green;
+			if(((i + j) & 1) == 0){
+				/// green: own color of row by row, other color by column
+				own = (value(d0, j - 1) + value(d0, j + 1)) >> 1;
+				up = value(dm1, j);
+				down = value(dp1, j);
+				int c = blue_row? value(d0, j) : value(dm2, j);
+				green = (value(dm1, j - 1) + value(dm1, j + 1) + value(dp1, j - 1) + value(dp1, j + 1) + c) / 5;
+			}else{
+				own = value(d0, j);
+				up = (value(dm1, j - 1) + value(dm1, j + 1)) >> 1;
+				down = (value(dp1, j - 1) + value(dp1, j + 1)) >> 1;
+				green = (value(dm1, j) + value(d0, j - 1) + value(d0, j + 1) + value(dp1, j)) >> 2;
+			}
+			int other = (up + down) >> 1;
+
+			int red = m_curve(blue_row? other : own);
+			int blue = m_curve(blue_row? own : other);
+			sl[j] = (blue) | (m_curve(green) << 8) | (red << 16) | MASK_ALPHAMAX_UCHAR;
 		}
 	}
 
-#if 1
-	/// red & blue
-	for(int i = 1; i < m_height/2 - 1; ++i){
-		ushort *d1 = m_tmp.at(i << 1);
-		ushort *d2 = m_tmp.at((i << 1) + 1);
-		for(int j = 1; j < m_width/2 - 1; ++j){
-			int red = 0, blue = 0;
-			red = (d1[(j << 1) - 1]	+ d1[(j << 1) + 1]) >> 1;
-			blue = (d2[(j << 1)] + d2[(j << 1) - 2]) >> 1;
-			d1[(j << 1)] = red;
-			d2[(j << 1) - 1] = blue;
-		}
+	emit log_message(OK, "end linear demoscaling");
+}
+
+bool RawReader::is_reference_linear() const
+{
+	return m_pattern == cfa::GRBG && m_color.is_identity();
+}
+
+void RawReader::demoscaling_linear_simd()
+{
+	if(m_initial.empty())
+		return;
+
+	if(!prepare_image())
+		return;
+
+	const ushort* bayer = m_initial.at(0);
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
+
+	pixel::Correction cc;
+	const pixel::Correction* c = correction(cc);
+
+	parallel_rows("linear", 0, m_height, [&](int y0, int y1){
+		simd::linear(bayer, m_initial.stride, m_width, m_height, m_lshift, c, m_curve, m_pattern, bits, bpl, m_simd_level, y0, y1);
+	});
+
+	emit log_message(OK, QString("end linear demoscaling (%1, %2)")
+					 .arg(simd::level_name(m_simd_level)).arg(cfa::name(m_pattern)));
+}
+
+void RawReader::demoscaling_hq(hq::METHOD method)
+{
+	if(m_initial.empty())
+		return;
+
+	if(!hq::supported(m_width, m_height)){
+		demoscaling();
+		emit log_message(WARNING, QString("frame is too small for %1, simple demoscaling is used").arg(hq::method_name(method)));
+		return;
 	}
 
-	/// green red blue
-	for(int i = 1; i < m_height/2 - 1; ++i){
-		QRgb* sl0 = reinterpret_cast< QRgb* >(m_image.scanLine(2 * i));
-		QRgb* sl1 = reinterpret_cast< QRgb* >(m_image.scanLine(2 * i + 1));
-		ushort *dm1 = m_tmp.at((i << 1) - 1);
-		ushort *d0 = m_tmp.at(i << 1);
-		ushort *dp1 = m_tmp.at((i << 1) + 1);
-		ushort *dp2 = m_tmp.at((i << 1) + 2);
-		for(int j = 1; j < m_width - 1; ++j){
-			int red = 0, blue = 0;
+	if(!prepare_image())
+		return;
 
-			red = d0[j];
-			red = minFast(MAX_UCHAR, red >> m_shift);
+	const ushort* bayer = m_initial.at(0);
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
 
-			blue = (dm1[j] + dp1[j]) >> 1;
-			blue = minFast(MAX_UCHAR, blue >> m_shift);
+	pixel::Correction cc;
+	const pixel::Correction* c = correction(cc);
 
-			sl0[j] |= (red << 16) | (blue);
+	parallel_rows(hq::method_name(method), 0, m_height, [&](int y0, int y1){
+		hq::demosaic(method, bayer, m_initial.stride, m_width, m_height, m_lshift, c, m_curve, m_pattern, bits, bpl, m_simd_level, y0, y1);
+	});
 
-			red = (d0[j] + dp2[j]) >> 1;
-			red = minFast(MAX_UCHAR, red >> m_shift);
+	emit log_message(OK, QString("end %1 demoscaling (%2)").arg(hq::method_name(method)).arg(cfa::name(m_pattern)));
+}
 
-			blue = dp1[j];
-			blue = minFast(MAX_UCHAR, blue >> m_shift);
+bool RawReader::rgb16_supported() const
+{
+	switch (m_demoscaling) {
+		case SIMPLE:
+		case MALVAR:
+		case VNG:
+		case AHD:
+			return true;
+		case LINEAR:
+			/// reference version of GRBG is not cached (see compute())
+			if(simd::linear_supported(m_width, m_height))
+				return m_simd_level != simd::SCALAR || !is_reference_linear();
+			return !is_reference_linear();
+		case GRAY:
+		default:
+			return false;
+	}
+}
+
+void RawReader::demoscaling_rgb16()
+{
+	if(m_initial.empty())
+		return;
 
-			sl1[j] |= (red << 16) | (blue);
+	m_rgb.create(m_height, m_width);
+	if(m_rgb.empty()){
+		emit log_message(ERROR, QString("not enough memory for frame %1x%2").arg(m_width).arg(m_height));
+		return;
+	}
+
+	const ushort* bayer = m_initial.at(0);
+	uchar* bits = reinterpret_cast< uchar* >(m_rgb.at(0));
+	const int bpl = m_rgb.stride * sizeof(quint64);
+	pixel::Correction cc;
+	const pixel::Correction* c = correction(cc);
+
+	bool simple = false;
+	/// method which is replaced by simple demoscaling (frame is too small for it)
+	const char* fallback = 0;
+	switch (m_demoscaling) {
+		case LINEAR:
+			if(!simd::linear_supported(m_width, m_height)){
+				fallback = "linear";
+				simple = true;
+				break;
+			}
+			parallel_rows("linear", 0, m_height, [&](int y0, int y1){
+				simd::linear_rgb16(bayer, m_initial.stride, m_width, m_height, m_lshift, c, m_pattern, bits, bpl, m_simd_level, y0, y1);
+			});
+			break;
+		case MALVAR:
+		case VNG:
+		case AHD:{
+			const hq::METHOD method = m_demoscaling == MALVAR? hq::MALVAR : (m_demoscaling == VNG? hq::VNG : hq::AHD);
+			if(!hq::supported(m_width, m_height)){
+				fallback = hq::method_name(method);
+				simple = true;
+				break;
+			}
+			parallel_rows(hq::method_name(method), 0, m_height, [&](int y0, int y1){
+				hq::demosaic_rgb16(method, bayer, m_initial.stride, m_width, m_height, m_lshift, c, m_pattern, bits, bpl, m_simd_level, y0, y1);
+			});
+			break;
 		}
+		case SIMPLE:
+		default:
+			simple = true;
+			break;
 	}
-#endif
 
-	emit log_message(OK, "end linear demoscaling");
+	if(simple){
+		const pixel::Rgb16 o = pixel::Rgb16();
+		parallel_rows("simple", 0, m_height, [&](int y0, int y1){
+			if(c){
+				const pixel::Corrected< pixel::Rgb16 > co = { o, cc };
+				demoscaling_rows(co, bits, bpl, y0, y1);
+			}else{
+				demoscaling_rows(o, bits, bpl, y0, y1);
+			}
+		});
+	}
+
+	if(fallback){
+		emit log_message(WARNING, QString("frame is too small for %1, simple demoscaling is used").arg(fallback));
+		return;
+	}
+	emit log_message(OK, QString("end %1 demoscaling to 16 bit (%2, %3)").arg(demoscaling_names[m_demoscaling])
+					 .arg(simd::level_name(m_simd_level)).arg(cfa::name(m_pattern)));
+}
+
+void RawReader::tone_map()
+{
+	if(m_rgb.empty())
+		return;
+
+	if(!prepare_image())
+		return;
+
+	const uchar* rgb = reinterpret_cast< const uchar* >(m_rgb.at(0));
+	const int rgb_bpl = m_rgb.stride * sizeof(quint64);
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
+
+	parallel_rows("tone", 0, m_height, [&](int y0, int y1){
+		simd::tone_map(rgb, rgb_bpl, m_width, m_curve, bits, bpl, m_simd_level, y0, y1);
+	});
 }
 
 void RawReader::create_image()
 {
-	if(m_bayer.empty())
+	if(m_initial.empty())
 		return;
 
-	m_image = QImage(m_width, m_height, QImage::Format_ARGB32);
+	if(!prepare_image())
+		return;
 
-	for(int i = 0; i < m_height; i++){
-		QRgb* sl = reinterpret_cast< QRgb* >(m_image.scanLine(i));
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
+
+	parallel_rows("gray", 0, m_height, [&](int y0, int y1){
+		create_image_rows(bits, bpl, y0, y1);
+	});
+}
+
+void RawReader::create_image_rows(uchar *bits, int bpl, int y0, int y1)
+{
+	for(int i = y0; i < y1; i++){
+		QRgb* sl = reinterpret_cast< QRgb* >(bits + (qint64)i * bpl);
 		for(int j = 0; j < m_width; j++){
-			ushort val = m_bayer.at(i, j);
-			val >>= m_shift;
-			val = minFast(val, MAX_UCHAR);
+			int val = m_curve(bayer(i, j));
 			sl[j] = qRgb(val, val, val);
 		}
 	}
 }
 
+void RawReader::demoscaling_half()
+{
+	if(m_initial.empty() || m_width < 2 || m_height < 2)
+		return;
+
+	const int width = m_width / 2, height = m_height / 2;
+	if(!prepare_image(width, height))
+		return;
+
+	uchar* bits = m_image.bits();
+	int bpl = m_image.bytesPerLine();
+
+	parallel_rows("half", 0, height, [&](int y0, int y1){
+		switch (m_pattern) {
+			case cfa::RGGB:
+				demoscaling_half_rows< cfa::RGGB >(bits, bpl, y0, y1);
+				break;
+			case cfa::BGGR:
+				demoscaling_half_rows< cfa::BGGR >(bits, bpl, y0, y1);
+				break;
+			case cfa::GBRG:
+				demoscaling_half_rows< cfa::GBRG >(bits, bpl, y0, y1);
+				break;
+			case cfa::GRBG:
+			default:
+				demoscaling_half_rows< cfa::GRBG >(bits, bpl, y0, y1);
+				break;
+		}
+	});
+
+	emit log_message(OK, QString("end half demoscaling (%1, %2x%3)").arg(cfa::name(m_pattern)).arg(width).arg(height));
+}
+
+template< int P >
+void RawReader::demoscaling_half_rows(uchar *bits, int bpl, int y0, int y1)
+{
+	typedef cfa::Layout< P > L;
+	const int width = m_width / 2;
+	const pixel::Tone8 o = { m_curve.lut() };
+	pixel::Correction cc;
+	const pixel::Correction* c = correction(cc);
+
+	for(int i = y0; i < y1; i++){
+		QRgb* sl = reinterpret_cast< QRgb* >(bits + (qint64)i * bpl);
+		/// row of red and row of blue of quad
+		const ushort* rr = m_initial.at(2 * i + L::RED_ROW);
+		const ushort* br = m_initial.at(2 * i + (L::RED_ROW ^ 1));
+		for(int j = 0; j < width; j++){
+			const int k = 2 * j;
+			ushort red		= rr[k + L::RED_COL] << m_lshift;
+			ushort green1	= rr[k + (L::RED_COL ^ 1)] << m_lshift;
+			ushort green2	= br[k + L::RED_COL] << m_lshift;
+			ushort blue		= br[k + (L::RED_COL ^ 1)] << m_lshift;
+			int r = red, g = (green1 + green2) >> 1, b = blue;
+			if(c)
+				(*c)(r, g, b);
+			sl[j] = o(r, g, b);
+		}
+	}
+}
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
 RawReaderWorker::RawReaderWorker()
 	: QThread(0)
-	, m_done(false)
+	, m_pending(false)
+	, m_busy(false)
 	, m_made(false)
+	, m_done(false)
+	, m_reload(false)
+	, m_cache(new FrameCache)
+	, m_time_exec(0)
+	, m_time_load(0)
+	, m_progressive(false)
+	, m_tiled(false)
 {
-
+	/// interactive changes of shift only remap cached result
+	m_reader.set_incremental(true);
+	m_settings = m_reader.settings();
 }
 
 RawReaderWorker::~RawReaderWorker()
 {
-	m_done = true;
+	{
+		QMutexLocker lock(&m_mutex);
+		m_done = true;
+		m_reader.cancel();
+		m_condition.wakeAll();
+	}
 
 	quit();
 	wait();
+
+	delete m_cache;
 }
 
 void RawReaderWorker::run()
 {
-	while(!m_done){
-		if(!m_start){
-			usleep(300);
-		}else{
-			m_start = false;
-			work();
+	forever{
+		Job job;
+		QRect tile;
+		{
+			QMutexLocker lock(&m_mutex);
+			while(!m_done && !m_pending && m_tiles.isEmpty()){
+				m_condition.wait(&m_mutex);
+			}
+			if(m_done)
+				return;
+
+			/// job has priority, tiles are taken one by one between jobs
+			if(!m_pending){
+				tile = m_tiles.first();
+				m_tiles.remove(0);
+			}else{
+				job = m_job;
+				m_pending = false;
+				m_busy = true;
+				/// cancel of previous job is not applied to this one
+				m_reader.clear_cancel();
+			}
+		}
+
+		if(!tile.isNull()){
+			QImage image = m_reader.compute_tile(tile, m_tile_reader);
+			if(!image.isNull())
+				emit tile_ready(tile, image);
+			continue;
+		}
+
+		/// file of cache (decoded ahead or shown before) is published at once, bayer of reader is not changed
+		FrameCache::Frame cached;
+		const bool hit = is_cacheable(job) && !job.reload && m_cache->find(job.fileName, job.settings, cached);
+		if(hit){
+			/// trace of reader is of other file
+			m_reader.trace().clear();
+			emit m_reader.log_message(RawReader::OK, QString("%1 from cache").arg(job.fileName));
 		}
+
+		bool frame = hit || (work(job) && !m_reader.image().isNull());
+
+		QStringList prefetch;
+		{
+			QMutexLocker lock(&m_mutex);
+			m_busy = false;
+			/// result is ready only if nothing is waiting
+			m_made = !m_pending;
+			prefetch = m_prefetch;
+		}
+
+		if(hit){
+			/// size and times are of the cached file, reader holds the previous one
+			FrameInfo info = cached.info;
+			info.cached = true;
+			emit frame_ready(cached.image, info);
+			emit stats_ready(cached.stats, cached.shift);
+		}else if(frame){
+			publish();
+			/// not a previous image when file is not read
+			if(is_cacheable(job) && !m_reader.empty()){
+				cached.image = m_front;
+				cached.info = frame_info();
+				cached.stats = m_reader.stats();
+				cached.shift = m_reader.shift();
+				m_cache->insert(job.fileName, job.settings, cached);
+			}
+		}
+
+		/// neighbours are decoded while the user looks at this file
+		if(frame)
+			m_cache->prefetch(job.fileName, prefetch, job.settings);
 	}
 }
 
+void RawReaderWorker::publish()
+{
+	/// new frame becomes front, previous front is the back buffer of the next compute
+	m_reader.swap_image(m_front);
+	emit frame_ready(m_front, frame_info());
+	emit stats_ready(m_reader.stats(), m_reader.shift());
+}
+
+FrameInfo RawReaderWorker::frame_info() const
+{
+	FrameInfo res;
+	res.size = QSize(m_reader.width(), m_reader.height());
+	res.time_load = m_time_load;
+	res.time_exec = m_time_exec;
+	res.time_per_mp = m_reader.time_per_mp();
+	res.thread_times = m_reader.thread_times();
+	return res;
+}
 
 bool RawReaderWorker::start_read_file(const QString &fn)
 {
 	if(!QFile::exists(fn))
 		return false;
 
+	/// the same file is read again, it may be rewritten
 	if(m_fileName == fn){
-		return true;
+		m_cache->remove(fn);
+		m_reload = true;
 	}
 
 	m_fileName = fn;
 
-	m_start = true;
+	start_compute();
 
 	return true;
 }
 
+void RawReaderWorker::set_prefetch(const QStringList &files)
+{
+	QMutexLocker lock(&m_mutex);
+	m_prefetch = files;
+}
+
+void RawReaderWorker::set_cache_budget(int megabytes)
+{
+	m_cache->set_budget(megabytes);
+}
+
+FrameCache &RawReaderWorker::cache()
+{
+	return *m_cache;
+}
+
 void RawReaderWorker::start_compute()
 {
-	m_start = true;
+	QMutexLocker lock(&m_mutex);
+
+	m_job.fileName = m_fileName;
+	m_job.settings = m_settings;
+	m_job.trace_dir = m_trace_dir;
+	m_job.progressive = m_progressive;
+	m_job.tiled = m_tiled;
+	/// reading of replaced job is not lost
+	m_job.reload = m_reload || (m_pending && m_job.reload);
+	m_reload = false;
+	m_pending = true;
+	m_made = false;
+
+	/// superseded job is stopped on the next strip
+	if(m_busy)
+		m_reader.cancel();
+
+	m_condition.wakeOne();
+}
+
+RawReader::Settings RawReaderWorker::settings() const
+{
+	return m_settings;
+}
+
+void RawReaderWorker::set_settings(const RawReader::Settings &value)
+{
+	m_settings = value;
 }
 
 bool RawReaderWorker::is_made() const
 {
+	QMutexLocker lock(&m_mutex);
 	return m_made;
 }
 
 bool RawReaderWorker::is_work() const
 {
-	return !m_made;
+	return !is_made();
 }
 
 RawReader &RawReaderWorker::reader()
@@ -581,63 +1553,155 @@ RawReader &RawReaderWorker::reader()
 	return m_reader;
 }
 
-void RawReaderWorker::work()
+bool RawReaderWorker::need_open(const Job &job) const
 {
-	m_made = false;
+	if(job.reload || m_reader.empty() || job.fileName != m_loaded.fileName)
+		return true;
+	if(job.settings.type != m_loaded.settings.type || job.settings.format != m_loaded.settings.format)
+		return true;
+	return job.settings.type == RawReader::RAW_TYPE_2 &&
+			(job.settings.width != m_loaded.settings.width || job.settings.height != m_loaded.settings.height
+			 || job.settings.frame != m_loaded.settings.frame);
+}
 
-	if(m_reader.empty()){
-		if(!open_image(m_fileName)){
-			if(!open_raw(m_fileName)){
-				m_made = true;
-				return;
+bool RawReaderWorker::is_cacheable(const RawReaderWorker::Job &job) const
+{
+	return !job.tiled && job.settings.frame == 0;
+}
+
+void RawReaderWorker::request_tiles(const QVector<QRect> &rects)
+{
+	QMutexLocker lock(&m_mutex);
+	/// only the last view is needed
+	m_tiles = rects;
+	if(!m_tiles.isEmpty())
+		m_condition.wakeOne();
+}
+
+bool RawReaderWorker::need_preview(const Job &job) const
+{
+	if(!job.progressive || job.tiled)
+		return false;
+	if(job.settings.demoscaling == RawReader::GRAY || job.settings.demoscaling == RawReader::HALF)
+		return false;
+	return !m_reader.is_cached();
+}
+
+bool RawReaderWorker::compute_half(const Job &job)
+{
+	m_reader.set_demoscaling(RawReader::HALF);
+	bool res = m_reader.compute();
+	m_reader.set_demoscaling(job.settings.demoscaling);
+	return res;
+}
+
+bool RawReaderWorker::work(const Job &job)
+{
+	m_reader.trace().clear();
+
+	m_time_counter.start();
+
+	bool res;
+	{
+		ScopedTimer timer(&m_reader.trace(), "work", "job");
+
+		m_reader.apply(job.settings);
+
+		if(need_open(job)){
+			m_reader.clear_bayer();
+			m_loaded = job;
+			if(job.settings.type == RawReader::RAW_TYPE_2)
+				m_reader.set_size(job.settings.width, job.settings.height);
+			if(!m_reader.open_file(job.fileName)){
+				/// previous frame is not left on screen for file which is not read (canceled ingest is replaced by next job)
+				if(!m_reader.is_canceled()){
+					m_front = QImage();
+					emit m_reader.log_message(RawReader::ERROR, QString("can not read %1").arg(job.fileName));
+					emit frame_ready(m_front, FrameInfo());
+				}
+				return false;
 			}
+			m_time_load = m_time_counter.elapsed();
 		}
-	}
 
-	m_time_counter.start();
-	int t1 = m_time_counter.elapsed();
+		int t1 = m_time_counter.elapsed();
+
+		if(job.tiled && job.settings.demoscaling != RawReader::GRAY){
+			/// overview under tiles, tiles are computed by the selected mode
+			res = compute_half(job);
+		}else{
+			if(need_preview(job)){
+				/// preview is shown at once, full frame replaces it when done
+				if(!compute_half(job))
+					return false;
+				publish();
+			}
+			res = m_reader.compute();
+		}
 
-	m_reader.compute();
+		if(res)
+			m_time_exec = m_time_counter.elapsed() - t1;
+	}
 
-	m_time_exec = m_time_counter.elapsed() - t1;
+	if(res)
+		save_trace(job.trace_dir);
 
-	m_made = true;
+	return res;
 }
 
-
-bool RawReaderWorker::open_raw(const QString fileName)
+void RawReaderWorker::save_trace(const QString &trace_dir)
 {
-	if(!fileName.contains(QRegExp("\.raw$|\.bin$", Qt::CaseInsensitive)))
-		return false;
-
-	QFile fl(fileName);
+	if(trace_dir.isEmpty())
+		return;
 
-	QByteArray data;
+	QDir dir(trace_dir);
+	if(!dir.exists() && !dir.mkpath(".")){
+		emit m_reader.log_message(RawReader::WARNING, QString("can not create %1").arg(trace_dir));
+		return;
+	}
 
-	if(fl.open(QIODevice::ReadOnly)){
-		data = fl.readAll();
-		fl.close();
+	QString name = dir.filePath(QString("trace_%1.json")
+								.arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss_zzz")));
+	if(!m_reader.trace().save(name))
+		emit m_reader.log_message(RawReader::WARNING, QString("can not write %1").arg(name));
+}
 
-		return m_reader.set_bayer_data(data);
-	}
-	return false;
+void RawReaderWorker::set_trace_dir(const QString &dir)
+{
+	m_trace_dir = dir;
 }
 
-bool RawReaderWorker::open_image(const QString fileName)
+QString RawReaderWorker::trace_dir() const
 {
-	if(!fileName.contains(QRegExp("\.jpeg$|\.jpg$|\.bmp$|\.png$", Qt::CaseInsensitive)))
-		return false;
+	return m_trace_dir;
+}
 
-	QImage image;
-	image.load(fileName);
+void RawReaderWorker::set_progressive(bool value)
+{
+	m_progressive = value;
+}
 
-	m_reader.set_type(RawReader::RAW_TYPE_NONE);
+bool RawReaderWorker::progressive() const
+{
+	return m_progressive;
+}
 
-	return m_reader.set_bayer_data(image);
+void RawReaderWorker::set_tiled(bool value)
+{
+	m_tiled = value;
 }
 
+bool RawReaderWorker::tiled() const
+{
+	return m_tiled;
+}
 
 int RawReaderWorker::time_exec() const
 {
 	return m_time_exec;
 }
+
+int RawReaderWorker::time_load() const
+{
+	return m_time_load;
+}
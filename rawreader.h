@@ -6,65 +6,29 @@
 #include <QImage>
 #include <QByteArray>
 #include <QTime>
+#include <QThreadPool>
+#include <QVector>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
 
-//////////////////////////////////////////////
-/// Matrix
+#include <functional>
 
-template< typename T >
-struct Mat{
-	explicit Mat(){
-		rows = cols = 0;
-	}
-	Mat(int rows, int cols){
-		this->rows = rows;
-		this->cols = cols;
-
-		data.resize(cols * rows);
-	}
-	Mat(const Mat< T >& m){
-		rows = m.rows;
-		cols = m.cols;
-		data = m.data;
-	}
-	Mat& operator= (const Mat< T >& m){
-		rows = m.rows;
-		cols = m.cols;
-		data = m.data;
-		return *this;
-	}
-	inline T& operator() (int i0, int i1){
-		return data[i0 * cols + i1];
-	}
-	inline T& operator[] (int i0){
-		return data[i0 * cols];
-	}
-	inline const T& operator[] (int i0) const{
-		return data[i0 * cols];
-	}
-	inline const T* at(int i0) const{
-		return &data[i0 * cols];
-	}
-	inline T* at(int i0){
-		return &data[i0 * cols];
-	}
-	inline T& at(int i0, int i1){
-		return data[i0 * cols + i1];
-	}
-	inline const T& at(int i0, int i1) const{
-		return data[i0 * cols + i1];
-	}
-	void clear(){
-		rows = cols = 0;
-		data.clear();
-	}
-	bool empty() const{
-		return data.size() == 0;
-	}
+#include "demosaic_simd.h"
+#include "demosaic_hq.h"
+#include "tonecurve.h"
+#include "trace.h"
+#include "pixel_out.h"
+#include "frameindex.h"
+#include "rawformat.h"
+#include "streamsink.h"
+#include "colorcorrection.h"
+#include "rawstats.h"
 
-	int rows;
-	int cols;
-	std::vector< T > data;
-};
+class QFile;
+class FrameCache;
+#include "mat.h"
 
 ///////////////////////////////////////////////
 /// \brief The RawReader class
@@ -83,13 +47,54 @@ public:
 	enum TYPE_DEMOSCALE{
 		GRAY,
 		SIMPLE,
-		LINEAR
+		LINEAR,
+		MALVAR,			/// gradient-corrected bilinear (Malvar-He-Cutler)
+		VNG,			/// variable number of gradients
+		AHD,			/// adaptive homogeneity-directed
+		HALF			/// preview of half size: 2x2 quad to one pixel
 	};
 	enum RAW_TYPE{
 		RAW_TYPE_NONE,		/// for loaded image
 		RAW_TYPE_1,			/// stream with width and height
 		RAW_TYPE_2			/// stream without width and height
 	};
+	/// rows of strip: compute() is canceled between strips
+	enum{
+		STRIP_ROWS = 64
+	};
+	/// source pixels around tile of compute_tile(), more than neighbourhood of any demoscaling
+	enum{
+		TILE_HALO = 8
+	};
+	/// rows of strip of stream_raw(): not less than frame needed by kernels, last strip is joined to previous one
+	enum{
+		MIN_STREAM_ROWS = 16
+	};
+
+	/**
+	 * @brief The Settings struct
+	 * параметры вычисления одним снимком.
+	 * width и height используются только при чтении RAW_TYPE_2
+	 */
+	struct Settings{
+		RAW_TYPE type;
+		int width;
+		int height;
+		RawFormat format;	/// layout of samples of raw file
+		int frame;			/// index of frame in sequence (RAW_TYPE_2 or stream of RAW_TYPE_1)
+		int shift;
+		bool auto_shift;	/// shift is taken from statistics of frame (RawStats::auto_shift)
+		int lshift;
+		TYPE_DEMOSCALE demoscaling;
+		cfa::PATTERN pattern;
+		ColorCorrection color;	/// black level, white balance and color matrix
+		simd::LEVEL simd_level;
+		int threads;
+		ToneCurve::TYPE curve;
+		double gamma;
+		double log_scale;
+		QVector< QPointF > points;
+	};
 
 	RawReader();
 	~RawReader();
@@ -100,6 +105,15 @@ public:
 	 * @return
 	 */
 	bool set_bayer_data(const QByteArray& data);
+	/**
+	 * @brief set_bayer_data
+	 * create bayer matrix from memory block (e.g. mapped file).
+	 * header is read in place, payload is unpacked by rows by kernel of format (see set_format)
+	 * @param data
+	 * @param size
+	 * @return
+	 */
+	bool set_bayer_data(const uchar* data, qint64 size);
 	/**
 	 * @brief set_bayer_data
 	 * create bayer matrix from image
@@ -107,6 +121,86 @@ public:
 	 * @return
 	 */
 	bool set_bayer_data(const QImage& image);
+	/**
+	 * @brief open_file
+	 * открыть изображение (jpg, bmp, png) или raw файл (raw, bin)
+	 * @param fileName
+	 * @return
+	 */
+	bool open_file(const QString& fileName);
+	/**
+	 * @brief open_raw
+	 * raw file is mapped and decoded in place
+	 * @param fileName
+	 * @return
+	 */
+	bool open_raw(const QString& fileName);
+	bool open_image(const QString& fileName);
+	/**
+	 * @brief stream_raw
+	 * кадр raw файла по полосам строк: окно файла читается, дебаеризуется текущим способом (без кэша)
+	 * и полоса результата отдается sink. память ограничена полосой (см. set_stream_memory),
+	 * а не размером кадра; соседние строки полосы берутся из файла, поэтому результат совпадает с compute().
+	 * после вызова кадра в памяти нет (empty()), width() и height() - размер кадра
+	 * @param fileName
+	 * @param sink
+	 * @return false on error of file or sink, or if it was canceled
+	 */
+	bool stream_raw(const QString& fileName, StreamSink* sink);
+	/**
+	 * @brief set_stream_memory
+	 * память полосы stream_raw (окно файла, источник и результат), МБ
+	 * @param megabytes
+	 */
+	void set_stream_memory(int megabytes);
+	int stream_memory() const;
+	/**
+	 * @brief stream_rows
+	 * строк полосы stream_raw для ширины кадра (четное, не меньше MIN_STREAM_ROWS)
+	 * @param width
+	 * @return
+	 */
+	int stream_rows(int width) const;
+	/**
+	 * @brief set_frame
+	 * номер кадра в файле RAW_TYPE_2 (кадры width x height записаны подряд)
+	 * или в потоке кадров RAW_TYPE_1 (каждый со своим заголовком), читается open_raw
+	 * @param index
+	 */
+	void set_frame(int index);
+	int frame() const;
+	/**
+	 * @brief frame_count
+	 * число кадров в последнем открытом файле (1 для изображений)
+	 * @return
+	 */
+	int frame_count() const;
+	/**
+	 * @brief set_frame_index
+	 * индекс кадров RAW_TYPE_1, уже открытый для файла (чтобы не читать sidecar при каждом кадре)
+	 * @param index
+	 */
+	void set_frame_index(const FrameIndex& index);
+	const FrameIndex& frame_index() const;
+	/**
+	 * @brief sequence_length
+	 * number of frames in file of RAW_TYPE_2, incomplete last frame is not counted
+	 * (but a file shorter than one frame is one frame with zero tail)
+	 * @param file_size
+	 * @param width
+	 * @param height
+	 * @param format
+	 * @return
+	 */
+	static int sequence_length(qint64 file_size, int width, int height, const RawFormat& format = RawFormat());
+	/**
+	 * @brief set_format
+	 * формат отсчетов raw файла: разрядность, упаковка MIPI, порядок байт, заголовок кадра и шаг строк.
+	 * для RAW_TYPE_1 заголовок формата идет после width и height
+	 * @param value
+	 */
+	void set_format(const RawFormat& value);
+	const RawFormat& format() const;
 	/**
 	 * @brief clear_bayer
 	 * clear bayer matrix
@@ -119,6 +213,11 @@ public:
 	 * @param shift
 	 */
 	void set_shift(int shift);
+	/**
+	 * @brief set_lshift
+	 * число бит для сдвига влево исходного значения (0..16, результат обрезается до 16 бит)
+	 * @param value
+	 */
 	void set_lshift(int value);
 	int lshift() const;
 	/**
@@ -127,18 +226,166 @@ public:
 	 * @param value
 	 */
 	void set_demoscaling(TYPE_DEMOSCALE value);
-	void compute();
+	/**
+	 * @brief set_pattern
+	 * расположение цветов фильтра (по умолчанию GRBG).
+	 * для каждого шаблона свой экземпляр ядер, выбор делается один раз на кадр
+	 * @param value
+	 */
+	void set_pattern(cfa::PATTERN value);
+	cfa::PATTERN pattern() const;
+	/**
+	 * @brief set_color
+	 * уровень черного, баланс белого и матрица цвета камеры в sRGB.
+	 * выполняются в ядрах дебаеризации над каждым пикселем перед выводом (целочисленно, без отдельного прохода).
+	 * GRAY не корректируется
+	 * @param value
+	 */
+	void set_color(const ColorCorrection& value);
+	const ColorCorrection& color() const;
+	/**
+	 * @brief set_auto_shift
+	 * сдвиг тоновой кривой выбирается по статистике кадра (см. stats()) при каждом compute(),
+	 * заданный set_shift() используется, если статистики нет (кадр из изображения)
+	 * @param value
+	 */
+	void set_auto_shift(bool value);
+	bool auto_shift() const;
+	/**
+	 * @brief stats
+	 * гистограммы, min, max и обрезанные отсчеты по позициям шаблона,
+	 * собираются полосами при чтении кадра (set_bayer_data) без отдельного прохода.
+	 * цвета позиций даны текущим шаблоном
+	 * @return
+	 */
+	RawStats stats() const;
+	/**
+	 * @brief set_simd_level
+	 * набор инструкций для дебаеризации (не выше поддерживаемого процессором).
+	 * simd::SCALAR - скалярная версия
+	 * @param value
+	 */
+	void set_simd_level(simd::LEVEL value);
+	simd::LEVEL simd_level() const;
+	/**
+	 * @brief set_thread_count
+	 * число потоков для вычисления (по умолчанию QThread::idealThreadCount()).
+	 * изображение делится на горизонтальные полосы по числу потоков
+	 * @param value
+	 */
+	void set_thread_count(int value);
+	int thread_count() const;
+	/**
+	 * @brief set_incremental
+	 * кэш результата дебаеризации в 16 битах на канал (8 байт на пиксель).
+	 * если изменились только сдвиг или кривая, compute() делает только тоновое преобразование.
+	 * GRAY и эталонный LINEAR (SCALAR, GRBG) всегда считаются заново
+	 * @param value
+	 */
+	void set_incremental(bool value);
+	bool incremental() const;
+	/**
+	 * @brief invalidate
+	 * сбросить кэш дебаеризации
+	 */
+	void invalidate();
+	/**
+	 * @brief is_cached
+	 * результат дебаеризации с текущими параметрами есть в кэше,
+	 * compute() сделает только тоновое преобразование
+	 * @return
+	 */
+	bool is_cached() const;
+	/**
+	 * @brief thread_times
+	 * время выполнения каждой полосы последнего вычисления, мс
+	 * @return
+	 */
+	QVector< double > thread_times() const;
+	/**
+	 * @brief time_per_mp
+	 * время последнего вычисления на мегапиксель, мс
+	 * @return
+	 */
+	double time_per_mp() const;
+	/**
+	 * @brief trace
+	 * время этапов (чтение, кривая, дебаеризация) и полос потоков.
+	 * события добавляются к текущим, новое задание начинается с trace().clear()
+	 * @return
+	 */
+	Trace& trace();
+	const Trace& trace() const;
+	/**
+	 * @brief settings
+	 * текущие параметры
+	 * @return
+	 */
+	Settings settings() const;
+	/**
+	 * @brief apply
+	 * установить все параметры, кроме размера (см. set_size)
+	 * @param value
+	 */
+	void apply(const Settings& value);
+	/**
+	 * @brief cancel
+	 * прервать compute() на границе полос (можно вызывать из другого потока).
+	 * флаг сбрасывается clear_cancel()
+	 */
+	void cancel();
+	void clear_cancel();
+	bool is_canceled() const;
+	/**
+	 * @brief compute
+	 * @return false if computation was canceled (image is incomplete)
+	 */
+	bool compute();
+	/**
+	 * @brief compute_tile
+	 * дебаеризация только прямоугольника кадра текущим способом (без кэша).
+	 * источник берется с запасом TILE_HALO, поэтому результат совпадает с compute().
+	 * тайл считается в context (его кадр - источник тайла), кадр и изображение этого объекта не меняются.
+	 * для HALF не поддерживается
+	 * @param rect - in coordinates of frame
+	 * @param context - reader of tiles, its buffers are reused by next tiles
+	 * @return image of rect & frame, null if there is no frame
+	 */
+	QImage compute_tile(const QRect& rect, RawReader& context);
 
 	int width() const;
 	int height() const;
 	void set_size(int w, int h);
+	/**
+	 * @brief image
+	 * результат последнего вычисления (буфер, в который пишет compute())
+	 * @return
+	 */
 	const QImage &image() const;
+	/**
+	 * @brief swap_image
+	 * обменять буфер результата без копирования. compute() использует полученный буфер повторно,
+	 * если на него больше нет ссылок
+	 * @param other
+	 */
+	void swap_image(QImage& other);
 	/**
 	 * @brief shift
 	 * текщий сдвиг значения пикселя
 	 * @return
 	 */
 	int shift() const;
+	/**
+	 * @brief set_curve
+	 * кривая преобразования значения пикселя в 8 бит.
+	 * таблица перестраивается в compute() только при изменении сдвига или кривой
+	 * @param type
+	 */
+	void set_curve(ToneCurve::TYPE type);
+	void set_curve_gamma(double value);
+	void set_curve_log_scale(double value);
+	void set_curve_points(const QVector< QPointF >& points);
+	const ToneCurve& curve() const;
 
 	void set_type(RAW_TYPE type);
 	RAW_TYPE type() const;
@@ -147,55 +394,247 @@ signals:
 	void log_message(RawReader::STATE_TYPE, const QString& text);
 
 private:
-	Mat< ushort > m_bayer;
+	/// source frame as read with mirrored halo of cfa::HALO; left shift is applied in demoscaling passes on the fly
 	Mat< ushort > m_initial;
-	Mat< ushort > m_tmp;
 
 	RAW_TYPE m_raw_type;
+	RawFormat m_format;
 	int m_lshift;
-	int m_shift;
+	bool m_auto_shift;
+	/// conversion of pixel value to 8 bit (right shift or curve)
+	ToneCurve m_curve;
 	int m_width;
 	int m_height;
+	int m_frame;
+	int m_frame_count;
+	int m_stream_memory;
+	/// frames of last file of RAW_TYPE_1
+	FrameIndex m_index;
 	QImage m_image;
 
 	TYPE_DEMOSCALE m_demoscaling;
+	cfa::PATTERN m_pattern;
+	ColorCorrection m_color;
+	simd::LEVEL m_simd_level;
+	/// statistics of samples of frame, collected by ingest
+	RawStats m_stats;
+
+	QThreadPool m_pool;
+	int m_thread_count;
+	QVector< double > m_thread_times;
+	double m_time_per_mp;
+	Trace m_trace;
+	QAtomicInt m_cancel;
+
+	/// parameters of cached result of demoscaling
+	struct RgbKey{
+		int bayer;
+		int lshift;
+		TYPE_DEMOSCALE demoscaling;
+		cfa::PATTERN pattern;
+		ColorCorrection color;
+		simd::LEVEL level;
+
+		bool operator== (const RgbKey& other) const{
+			return bayer == other.bayer && lshift == other.lshift && demoscaling == other.demoscaling
+					&& pattern == other.pattern && color == other.color && level == other.level;
+		}
+	};
+	bool m_incremental;
+	/// counter of changes of bayer matrix
+	int m_bayer_version;
+	/// result of demoscaling before tone mapping (pixel::Rgb16)
+	Mat< quint64 > m_rgb;
+	RgbKey m_rgb_key;
+	bool m_rgb_valid;
+
+	/**
+	 * @brief parallel_rows
+	 * split rows [y0, y1) to bands by number of threads, every band is computed by strips of STRIP_ROWS:
+	 * func(strip_y0, strip_y1). strips write only own rows of output, neighbour rows of input are shared.
+	 * rest of strips is skipped after cancel()
+	 * @param name - name of bands in trace
+	 * @param y0
+	 * @param y1
+	 * @param func
+	 */
+	void parallel_rows(const char* name, int y0, int y1, const std::function< void(int, int) >& func);
+	/**
+	 * @brief find_frame
+	 * bytes of frame m_frame in opened file (frame count is updated)
+	 * @return false if frame is out of file
+	 */
+	bool find_frame(QFile& fl, qint64& offset, qint64& size);
+	/**
+	 * @brief correction
+	 * m_color in fixed point for kernels
+	 * @param value - buffer of result
+	 * @return &value or 0 for identity
+	 */
+	const pixel::Correction* correction(pixel::Correction& value) const;
+	/**
+	 * @brief prepare_image
+	 * output of size of frame: buffer is allocated only if it can not be reused
+	 * @return false if there is no memory (image is null)
+	 */
+	bool prepare_image();
+	bool prepare_image(int width, int height);
 	/**
 	 * @brief create_image
 	 * серое изображение
 	 */
 	void create_image();
+	void create_image_rows(uchar* bits, int bpl, int y0, int y1);
+	/**
+	 * @brief demoscaling_half
+	 * быстрый просмотр: изображение половинного размера, каждый квадрат 2x2 - один пиксель
+	 * (красный, среднее зеленых, синий)
+	 */
+	void demoscaling_half();
+	template< int P >
+	void demoscaling_half_rows(uchar* bits, int bpl, int y0, int y1);
 	/**
 	 * @brief demoscaling
 	 * дебаеризация медленная (хз какой алгоритм)
 	 */
 	void demoscaling();
-
-	inline int getred(int i, int j);
-	inline int getblue(int i, int j);
-	inline int getgreen(int i, int j);
+	/**
+	 * @brief demoscaling_rows
+	 * rows [y0, y1) of slow demoscaling, output O is pixel::Tone8 or pixel::Rgb16
+	 */
+	template< typename O >
+	void demoscaling_rows(const O& o, uchar* bits, int bpl, int y0, int y1);
+	template< int P, typename O >
+	void demoscaling_rows_cfa(const O& o, uchar* bits, int bpl, int y0, int y1);
+	/**
+	 * @brief demoscaling_row
+	 * row i of pattern P, Y - parity of row
+	 */
+	template< int P, int Y, typename O >
+	void demoscaling_row(const O& o, typename O::Pixel* sl, int i);
+	/**
+	 * @brief simple_pixel
+	 * pixel (i, j) with parity of row Y and column X
+	 */
+	template< int P, int Y, int X, typename O >
+	inline typename O::Pixel simple_pixel(const O& o, int i, int j);
+	/**
+	 * @brief demoscaling_direct
+	 * дебаеризация сразу в 8 бит (без кэша) выбранным способом
+	 */
+	void demoscaling_direct();
 	/**
 	 * @brief demoscaling_linear
-	 * дебаеризация по билинейному алгоритму
+	 * дебаеризация по билинейному алгоритму (только GRBG), весь кадр одним циклом (край в halo)
 	 */
 	void demoscaling_linear();
+	/**
+	 * @brief is_reference_linear
+	 * demoscaling_linear is valid for current parameters (GRBG without correction)
+	 */
+	bool is_reference_linear() const;
+	/**
+	 * @brief demoscaling_linear_simd
+	 * то же, векторная версия в один проход
+	 */
+	void demoscaling_linear_simd();
+	/**
+	 * @brief demoscaling_hq
+	 * дебаеризация высокого качества (Malvar-He-Cutler, VNG, AHD)
+	 * @param method
+	 */
+	void demoscaling_hq(hq::METHOD method);
+	/**
+	 * @brief rgb16_supported
+	 * current mode may be cached in m_rgb
+	 */
+	bool rgb16_supported() const;
+	/**
+	 * @brief demoscaling_rgb16
+	 * дебаеризация в m_rgb без тонового преобразования
+	 */
+	void demoscaling_rgb16();
+	/**
+	 * @brief tone_map
+	 * m_rgb to output image by curve
+	 */
+	void tone_map();
 
-	void left_shift();
+	/**
+	 * @brief bayer
+	 * value of source after left shift
+	 * @param i
+	 * @param j
+	 * @return
+	 */
+	inline int bayer(int i, int j) const{
+		return static_cast< ushort >(m_initial.at(i, j) << m_lshift);
+	}
+	/// value of row of bayer after left shift (j may be in halo)
+	inline int value(const ushort* row, int j) const{
+		return static_cast< ushort >(row[j] << m_lshift);
+	}
 };
 
+//////////////////////////////////
+/// \brief The FrameInfo struct
+/// size of frame and times of job, sent with frame:
+/// reader belongs to thread of worker, so UI does not read it
+
+struct FrameInfo{
+	FrameInfo();
+
+	QSize size;						/// size of frame (image of HALF is smaller)
+	int time_load;					/// ms
+	int time_exec;					/// ms
+	double time_per_mp;				/// ms
+	QVector< double > thread_times;	/// ms of bands of the last stage
+	bool cached;					/// frame is taken from FrameCache, times are of its decoding
+};
+
+Q_DECLARE_METATYPE(FrameInfo)
+
 //////////////////////////////////
 
 class RawReaderWorker: public QThread{
+	Q_OBJECT
 public:
 	RawReaderWorker();
 	~RawReaderWorker();
 	/**
 	 * @brief start_read_file
-	 * открыть файл
+	 * открыть файл. кадр файла из кэша показывается сразу; тот же файл читается заново
+	 * (он мог быть перезаписан)
 	 * @param fn
 	 * @return
 	 */
 	bool start_read_file(const QString& fn);
+	/**
+	 * @brief set_prefetch
+	 * файлы для декодирования заранее (ближайшие первыми), в кэш после каждого задания
+	 * @param files
+	 */
+	void set_prefetch(const QStringList& files);
+	/**
+	 * @brief set_cache_budget
+	 * память кэша декодированных файлов
+	 * @param megabytes
+	 */
+	void set_cache_budget(int megabytes);
+	FrameCache& cache();
+	/**
+	 * @brief start_compute
+	 * новое задание с текущими параметрами. задание в очереди заменяется,
+	 * выполняемое прерывается на границе полос
+	 */
 	void start_compute();
+	/**
+	 * @brief settings
+	 * параметры следующего задания
+	 * @return
+	 */
+	RawReader::Settings settings() const;
+	void set_settings(const RawReader::Settings& value);
 	/**
 	 * @brief is_made
 	 * готово или нет
@@ -214,28 +653,152 @@ public:
 	 * @return
 	 */
 	int time_exec() const;
+	/**
+	 * @brief time_load
+	 * время загрузки файла
+	 * @return
+	 */
+	int time_load() const;
+	/**
+	 * @brief set_trace_dir
+	 * каталог для трассы каждого задания (json для chrome://tracing, Perfetto).
+	 * пустая строка - трасса не сохраняется
+	 * @param dir
+	 */
+	void set_trace_dir(const QString& dir);
+	QString trace_dir() const;
+	/**
+	 * @brief set_progressive
+	 * сначала показать просмотр половинного размера (HALF), потом полный кадр.
+	 * просмотр не делается, если полный кадр будет быстрым (GRAY, HALF, кэш)
+	 * @param value
+	 */
+	void set_progressive(bool value);
+	bool progressive() const;
+	/**
+	 * @brief set_tiled
+	 * кадр целиком не нужен (просмотр по тайлам в увеличении):
+	 * задание считает только обзор HALF, видимые тайлы запрашиваются через request_tiles()
+	 * @param value
+	 */
+	void set_tiled(bool value);
+	bool tiled() const;
 	RawReader& reader();
 
+public slots:
+	/**
+	 * @brief request_tiles
+	 * прямоугольники кадра для дебаеризации, когда нет задания. заменяет предыдущий запрос,
+	 * результат приходит по tile_ready()
+	 * @param rects
+	 */
+	void request_tiles(const QVector< QRect >& rects);
+
+signals:
+	/**
+	 * @brief frame_ready
+	 * готовый кадр (front buffer). изображение разделяется без копирования,
+	 * worker в него больше не пишет
+	 * @param image
+	 * @param info - size of frame and times of job
+	 */
+	void frame_ready(const QImage& image, const FrameInfo& info);
+	/**
+	 * @brief tile_ready
+	 * тайл с параметрами последнего кадра
+	 * @param rect - in coordinates of frame
+	 * @param image
+	 */
+	void tile_ready(const QRect& rect, const QImage& image);
+	/**
+	 * @brief stats_ready
+	 * статистика кадра вместе с frame_ready
+	 * @param stats
+	 * @param shift - used shift of tone curve (selected by statistics if auto_shift)
+	 */
+	void stats_ready(const RawStats& stats, int shift);
+
 protected:
 	virtual void run();
 
 private:
+	/// задание: файл и снимок параметров
+	struct Job{
+		QString fileName;
+		RawReader::Settings settings;
+		QString trace_dir;
+		bool progressive;
+		bool tiled;
+		bool reload;		/// file is read again even if it is loaded
+	};
+
+	mutable QMutex m_mutex;
+	QWaitCondition m_condition;
+	/// next job, only the last one is kept
+	Job m_job;
+	bool m_pending;
+	/// requested tiles, computed only when there is no job
+	QVector< QRect > m_tiles;
+	bool m_busy;
 	bool m_made;
-	QString m_fileName;
-	bool m_start;
 	bool m_done;
+
+	QString m_fileName;
+	RawReader::Settings m_settings;
+	bool m_reload;
+	/// files decoded ahead after job (guarded by m_mutex)
+	QStringList m_prefetch;
+	FrameCache* m_cache;
+	/// file and reading parameters of current bayer data (used only by thread of worker)
+	Job m_loaded;
+
 	QTime m_time_counter;
 	int m_time_exec;
+	int m_time_load;
+	QString m_trace_dir;
+	bool m_progressive;
+	bool m_tiled;
 
 	RawReader m_reader;
+	/// tiles are computed here, frame of m_reader is not changed
+	RawReader m_tile_reader;
+	/// last published frame
+	QImage m_front;
 
-	bool open_raw(const QString fileName);
-	bool open_image(const QString fileName);
 	/**
 	 * @brief work
 	 * открыть файл и преобразовать в изображения
+	 * @return false if job was canceled
+	 */
+	bool work(const Job& job);
+	/**
+	 * @brief need_open
+	 * file or its reading parameters are changed
+	 */
+	bool need_open(const Job& job) const;
+	/**
+	 * @brief is_cacheable
+	 * result of job is the whole first frame of file (not overview of tiles), it is kept in cache
+	 */
+	bool is_cacheable(const Job& job) const;
+	/**
+	 * @brief need_preview
+	 * full frame is slow enough to show preview before it
+	 */
+	bool need_preview(const Job& job) const;
+	/**
+	 * @brief compute_half
+	 * frame of HALF, mode of job stays for next compute and tiles
+	 */
+	bool compute_half(const Job& job);
+	/**
+	 * @brief publish
+	 * image of reader becomes front buffer and is sent by frame_ready()
 	 */
-	void work();
+	void publish();
+	/// size and times of job of m_reader
+	FrameInfo frame_info() const;
+	void save_trace(const QString& dir);
 };
 
 #endif // RAWREADER_H
@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# decoder and demoscaling (QtCore, QtGui), shared by raw_reader and raw_convert
+#
+#-------------------------------------------------
+
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/rawreader.cpp \
+    $$PWD/demosaic_simd.cpp \
+    $$PWD/tonecurve.cpp \
+    $$PWD/demosaic_hq.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/sequenceplayer.cpp \
+    $$PWD/frameindex.cpp \
+    $$PWD/mat.cpp \
+    $$PWD/rawformat.cpp \
+    $$PWD/streamsink.cpp \
+    $$PWD/colorcorrection.cpp \
+    $$PWD/rawstats.cpp \
+    $$PWD/framecache.cpp
+
+HEADERS += $$PWD/rawreader.h \
+    $$PWD/demosaic_simd.h \
+    $$PWD/tonecurve.h \
+    $$PWD/cfa.h \
+    $$PWD/demosaic_hq.h \
+    $$PWD/simd_target.h \
+    $$PWD/trace.h \
+    $$PWD/pixel_out.h \
+    $$PWD/sequenceplayer.h \
+    $$PWD/frameindex.h \
+    $$PWD/mat.h \
+    $$PWD/rawformat.h \
+    $$PWD/streamsink.h \
+    $$PWD/colorcorrection.h \
+    $$PWD/rawstats.h \
+    $$PWD/framecache.h
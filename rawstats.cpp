@@ -0,0 +1,170 @@
+#include "rawstats.h"
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+const double RawStats::AUTO_FRACTION = 0.999;
+
+RawStats::RawStats()
+	: pattern(cfa::GRBG)
+{
+	reset(0);
+}
+
+void RawStats::reset(int bits)
+{
+	this->bits = bits;
+	for(int q = 0; q < QUADS; ++q){
+		count[q] = 0;
+		min[q] = INT_MAX;
+		max[q] = 0;
+		clipped[q] = 0;
+	}
+	memset(hist, 0, sizeof(hist));
+}
+
+bool RawStats::is_valid() const
+{
+	return bits > 0 && count[0] + count[1] + count[2] + count[3] > 0;
+}
+
+int RawStats::bin_shift() const
+{
+	return qMax(0, bits - (int)BINS_BITS);
+}
+
+void RawStats::add_row(const ushort *row, int width, int y)
+{
+	const int shift = bin_shift();
+	const int white = (1 << bits) - 1;
+
+	/// every parity of column is one position, loop has no branches by color
+	for(int k = 0; k < 2 && k < width; ++k){
+		const int q = (y & 1) * 2 + k;
+		qint64* h = hist[q];
+		int lo = min[q];
+		int hi = max[q];
+		qint64 clip = 0;
+		for(int j = k; j < width; j += 2){
+			const int value = row[j];
+			h[qMin(value >> shift, (int)BINS - 1)]++;
+			lo = qMin(lo, value);
+			hi = qMax(hi, value);
+			clip += value >= white;
+		}
+		min[q] = lo;
+		max[q] = hi;
+		clipped[q] += clip;
+		count[q] += (width - k + 1) / 2;
+	}
+}
+
+void RawStats::merge(const RawStats &other)
+{
+	for(int q = 0; q < QUADS; ++q){
+		count[q] += other.count[q];
+		min[q] = qMin(min[q], other.min[q]);
+		max[q] = qMax(max[q], other.max[q]);
+		clipped[q] += other.clipped[q];
+		for(int i = 0; i < BINS; ++i){
+			hist[q][i] += other.hist[q][i];
+		}
+	}
+}
+
+int RawStats::color(int quad) const
+{
+	return cfa::color(pattern, quad >> 1, quad & 1);
+}
+
+qint64 RawStats::channel_count(int channel) const
+{
+	qint64 res = 0;
+	for(int q = 0; q < QUADS; ++q){
+		if(color(q) == channel)
+			res += count[q];
+	}
+	return res;
+}
+
+int RawStats::channel_min(int channel) const
+{
+	int res = INT_MAX;
+	for(int q = 0; q < QUADS; ++q){
+		if(color(q) == channel && count[q])
+			res = qMin(res, min[q]);
+	}
+	return res == INT_MAX? 0 : res;
+}
+
+int RawStats::channel_max(int channel) const
+{
+	int res = 0;
+	for(int q = 0; q < QUADS; ++q){
+		if(color(q) == channel)
+			res = qMax(res, max[q]);
+	}
+	return res;
+}
+
+qint64 RawStats::channel_bin(int channel, int bin) const
+{
+	qint64 res = 0;
+	for(int q = 0; q < QUADS; ++q){
+		if(color(q) == channel)
+			res += hist[q][bin];
+	}
+	return res;
+}
+
+double RawStats::clipped_percent(int channel) const
+{
+	const qint64 total = channel_count(channel);
+	if(!total)
+		return 0;
+
+	qint64 res = 0;
+	for(int q = 0; q < QUADS; ++q){
+		if(color(q) == channel)
+			res += clipped[q];
+	}
+	return 100. * res / total;
+}
+
+int RawStats::percentile(int channel, double fraction) const
+{
+	const qint64 total = channel_count(channel);
+	if(!total)
+		return 0;
+
+	const qint64 target = qMax< qint64 >(1, (qint64)ceil(qBound(0., fraction, 1.) * total));
+
+	qint64 sum = 0;
+	int i = 0;
+	for(; i < BINS - 1; ++i){
+		sum += channel_bin(channel, i);
+		if(sum >= target)
+			break;
+	}
+	return qBound(channel_min(channel), ((i + 1) << bin_shift()) - 1, channel_max(channel));
+}
+
+int RawStats::auto_shift(int lshift, double fraction) const
+{
+	if(!is_valid())
+		return 0;
+
+	int high = 0;
+	for(int c = 0; c < CHANNELS; ++c){
+		high = qMax(high, percentile(c, fraction));
+	}
+	/// values of kernels are 16 bit
+	const qint64 value = qMin< qint64 >(0xffff, (qint64)high << qBound(0, lshift, 16));
+
+	int shift = 0;
+	while((value >> shift) > 255){
+		shift++;
+	}
+	return shift;
+}
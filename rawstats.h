@@ -0,0 +1,85 @@
+#ifndef RAWSTATS_H
+#define RAWSTATS_H
+
+#include <QtGlobal>
+#include <QMetaType>
+
+#include "cfa.h"
+
+///////////////////////////////////////////////
+/// \brief The RawStats struct
+/// statistics of raw frame: histogram, min, max and clipped samples of every position of bayer quad.
+/// strips of ingest collect own statistics from just unpacked rows and join them (merge),
+/// so the frame is not read again. colors are given by pattern at query time,
+/// so pattern may be changed after the frame is read
+///
+
+struct RawStats{
+	enum{
+		QUADS = 4,			/// positions of quad: (row & 1) * 2 + (col & 1)
+		CHANNELS = 3,		/// cfa::COLOR
+		BINS_BITS = 10,
+		BINS = 1 << BINS_BITS
+	};
+
+	int bits;						/// depth of samples: values are in [0, 2^bits)
+	cfa::PATTERN pattern;			/// colors of positions
+	qint64 count[QUADS];
+	int min[QUADS];
+	int max[QUADS];
+	qint64 clipped[QUADS];			/// samples of full scale (2^bits - 1)
+	qint64 hist[QUADS][BINS];		/// bin of value is value >> bin_shift()
+
+	RawStats();
+
+	/// empty statistics of samples of depth bits
+	void reset(int bits);
+	/// there are samples
+	bool is_valid() const;
+	int bin_shift() const;
+	/**
+	 * @brief add_row
+	 * samples of row y of frame
+	 * @param row
+	 * @param width
+	 * @param y - parity of row gives positions of samples
+	 */
+	void add_row(const ushort* row, int width, int y);
+	/// join statistics of other rows of the same frame
+	void merge(const RawStats& other);
+
+	/// color of position of quad by pattern
+	int color(int quad) const;
+	/// by channel (cfa::COLOR), both greens are one channel
+	qint64 channel_count(int channel) const;
+	int channel_min(int channel) const;
+	int channel_max(int channel) const;
+	qint64 channel_bin(int channel, int bin) const;
+	/// clipped samples of channel in percent
+	double clipped_percent(int channel) const;
+	/**
+	 * @brief percentile
+	 * value below which fraction of samples of channel is (upper bound of bin)
+	 * @param channel - cfa::COLOR
+	 * @param fraction - 0..1
+	 * @return
+	 */
+	int percentile(int channel, double fraction) const;
+
+	/**
+	 * @brief auto_shift
+	 * the least shift of tone mapping with which percentile of the brightest channel (after left shift)
+	 * is not over 255 (white point of curve), so few highlights are saturated and shadows keep the most bits
+	 * @param lshift
+	 * @param fraction
+	 * @return
+	 */
+	int auto_shift(int lshift, double fraction = AUTO_FRACTION) const;
+
+	/// part of samples under white of auto_shift()
+	static const double AUTO_FRACTION;
+};
+
+Q_DECLARE_METATYPE(RawStats)
+
+#endif // RAWSTATS_H
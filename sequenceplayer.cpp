@@ -0,0 +1,335 @@
+#include "sequenceplayer.h"
+
+#include <QFileInfo>
+#include <QRegExp>
+#include <QRunnable>
+#include <QMetaObject>
+
+Q_DECLARE_METATYPE(FrameIndex)
+
+static const int reg_frame_index = qRegisterMetaType<FrameIndex>("FrameIndex");
+
+/////////////////////////////////
+/// \brief The IndexTask class
+/// index of stream of RAW_TYPE_1 (sidecar or pass over headers) out of thread of UI
+
+class IndexTask: public QRunnable{
+public:
+	IndexTask(SequencePlayer* owner, const QString& fileName, const RawFormat& format, int generation)
+		: m_owner(owner)
+		, m_fileName(fileName)
+		, m_format(format)
+		, m_generation(generation)
+	{
+	}
+	virtual void run(){
+		FrameIndex index;
+		/// failed file is reported with empty index
+		index.open(m_fileName, m_format);
+		QMetaObject::invokeMethod(m_owner, "on_indexed", Qt::QueuedConnection,
+								  Q_ARG(int, m_generation), Q_ARG(FrameIndex, index));
+	}
+
+private:
+	SequencePlayer* m_owner;
+	QString m_fileName;
+	RawFormat m_format;
+	int m_generation;
+};
+
+/////////////////////////////////
+/// \brief The DecodeTask class
+/// one frame: reading, demoscaling and tone mapping by reader of player in one thread
+
+class DecodeTask: public QRunnable{
+public:
+	DecodeTask(SequencePlayer* owner, const QString& fileName, const RawReader::Settings& settings,
+			   const FrameIndex& index, qint64 tick, int frame, int generation, const QAtomicInt* current)
+		: m_owner(owner)
+		, m_fileName(fileName)
+		, m_settings(settings)
+		, m_index(index)
+		, m_tick(tick)
+		, m_frame(frame)
+		, m_generation(generation)
+		, m_current(current)
+	{
+	}
+	virtual void run(){
+		QImage image;
+		/// superseded task is not computed, but it is reported to free its place
+		if(m_current->loadAcquire() == m_generation){
+			RawReader* reader = m_owner->take_reader();
+			RawReader::Settings settings = m_settings;
+			settings.frame = m_frame;
+			settings.threads = 1;
+			reader->apply(settings);
+			reader->set_size(settings.width, settings.height);
+			reader->set_frame_index(m_index);
+			/// image is shared with ring, so the next frame of reader gets its own buffer
+			if(reader->open_file(m_fileName) && reader->compute())
+				image = reader->image();
+			m_owner->put_reader(reader);
+		}
+		QMetaObject::invokeMethod(m_owner, "on_decoded", Qt::QueuedConnection,
+								  Q_ARG(int, m_generation), Q_ARG(qint64, m_tick), Q_ARG(QImage, image));
+	}
+
+private:
+	SequencePlayer* m_owner;
+	QString m_fileName;
+	RawReader::Settings m_settings;
+	FrameIndex m_index;
+	qint64 m_tick;
+	int m_frame;
+	int m_generation;
+	const QAtomicInt* m_current;
+};
+
+/////////////////////////////////
+
+SequencePlayer::SequencePlayer(QObject *parent)
+	: QObject(parent)
+	, m_count(0)
+	, m_tick(0)
+	, m_show_next(false)
+	, m_decoding(0)
+	, m_late(0)
+	, m_fps(25)
+{
+	set_capacity(16);
+	m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+
+	m_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(on_tick()));
+}
+
+SequencePlayer::~SequencePlayer()
+{
+	/// tasks hold pointer to this
+	m_generation.fetchAndAddOrdered(1);
+	m_pool.clear();
+	m_pool.waitForDone();
+	qDeleteAll(m_readers);
+}
+
+void SequencePlayer::open(const QString &fileName, const RawReader::Settings &settings)
+{
+	close();
+
+	m_fileName = fileName;
+	m_settings = settings;
+
+	if(settings.type == RawReader::RAW_TYPE_2){
+		start(RawReader::sequence_length(QFileInfo(fileName).size(), settings.width, settings.height, settings.format));
+	}else if(settings.type == RawReader::RAW_TYPE_1
+			 && fileName.contains(QRegExp("\\.raw$|\\.bin$", Qt::CaseInsensitive))){
+		/// built once by pass over headers, later it is read from sidecar; result of closed file is dropped
+		IndexTask* task = new IndexTask(this, fileName, settings.format, m_generation.loadAcquire());
+		task->setAutoDelete(true);
+		m_pool.start(task);
+	}else{
+		start(0);
+	}
+}
+
+void SequencePlayer::close()
+{
+	pause();
+	m_fileName.clear();
+	m_index.clear();
+	m_count = 0;
+	restart();
+}
+
+void SequencePlayer::set_settings(const RawReader::Settings &settings)
+{
+	m_settings = settings;
+	if(m_count){
+		restart();
+		/// the current frame with new parameters
+		m_show_next = !is_playing();
+	}
+}
+
+int SequencePlayer::frame_count() const
+{
+	return m_count;
+}
+
+int SequencePlayer::position() const
+{
+	return m_count? m_tick % m_count : 0;
+}
+
+bool SequencePlayer::is_playing() const
+{
+	return m_timer.isActive();
+}
+
+void SequencePlayer::set_fps(double value)
+{
+	m_fps = qMax(0.1, value);
+	m_timer.setInterval(qRound(1000. / m_fps));
+}
+
+double SequencePlayer::fps() const
+{
+	return m_fps;
+}
+
+void SequencePlayer::set_capacity(int frames)
+{
+	m_ring.fill(Slot(), qMax(2, frames));
+	restart();
+}
+
+int SequencePlayer::late_frames() const
+{
+	return m_late;
+}
+
+RawReader *SequencePlayer::take_reader()
+{
+	QMutexLocker lock(&m_readers_mutex);
+	if(m_readers.isEmpty())
+		return new RawReader;
+	return m_readers.takeLast();
+}
+
+void SequencePlayer::put_reader(RawReader *reader)
+{
+	QMutexLocker lock(&m_readers_mutex);
+	m_readers.append(reader);
+}
+
+void SequencePlayer::play()
+{
+	if(!m_count || is_playing())
+		return;
+	m_late = 0;
+	m_show_next = false;
+	m_timer.start(qRound(1000. / m_fps));
+	schedule();
+}
+
+void SequencePlayer::pause()
+{
+	m_timer.stop();
+}
+
+void SequencePlayer::seek(int index)
+{
+	if(!m_count)
+		return;
+	/// frames after new position which are already in ring stay there
+	m_tick = qBound(0, index, m_count - 1);
+	m_show_next = !is_playing();
+	schedule();
+	if(m_show_next && show(m_tick))
+		m_show_next = false;
+}
+
+void SequencePlayer::on_tick()
+{
+	if(show(m_tick)){
+		m_tick++;
+		schedule();
+	}else{
+		/// frame is not ready: playback waits for it
+		m_late++;
+	}
+}
+
+void SequencePlayer::on_indexed(int generation, const FrameIndex &index)
+{
+	if(generation != m_generation.loadAcquire())
+		return;
+	m_index = index;
+	start(m_index.size());
+}
+
+void SequencePlayer::on_decoded(int generation, qint64 tick, const QImage &image)
+{
+	m_decoding--;
+
+	Slot& s = slot(tick);
+	if(generation == m_generation.loadAcquire() && s.tick == tick && s.state == DECODING){
+		s.image = image;
+		s.state = READY;
+		if(m_show_next && tick == m_tick && show(m_tick))
+			m_show_next = false;
+	}
+	schedule();
+}
+
+SequencePlayer::Slot &SequencePlayer::slot(qint64 tick)
+{
+	return m_ring[tick % m_ring.size()];
+}
+
+void SequencePlayer::schedule()
+{
+	/// paused player decodes only for requested frame
+	if(!m_count || (!is_playing() && !m_show_next))
+		return;
+
+	const int generation = m_generation.loadAcquire();
+	const int ahead = qMin(m_ring.size(), m_count);
+
+	for(qint64 tick = m_tick; tick < m_tick + ahead; ++tick){
+		Slot& s = slot(tick);
+		/// slot of passed frame is taken by frame ahead
+		if(s.tick != tick){
+			s.tick = tick;
+			s.state = EMPTY;
+			s.image = QImage();
+		}
+		if(s.state != EMPTY)
+			continue;
+		if(m_decoding >= m_pool.maxThreadCount())
+			break;
+
+		DecodeTask* task = new DecodeTask(this, m_fileName, m_settings, m_index, tick, tick % m_count, generation, &m_generation);
+		task->setAutoDelete(true);
+		m_pool.start(task);
+		s.state = DECODING;
+		m_decoding++;
+	}
+}
+
+void SequencePlayer::restart()
+{
+	/// tasks of previous generation are not removed from pool: every task reports to free its place
+	m_generation.fetchAndAddOrdered(1);
+	for(int i = 0; i < m_ring.size(); ++i){
+		m_ring[i].tick = -1;
+		m_ring[i].state = EMPTY;
+		m_ring[i].image = QImage();
+	}
+	schedule();
+}
+
+void SequencePlayer::start(int count)
+{
+	if(count <= 0){
+		m_fileName.clear();
+		m_index.clear();
+		emit opened(0);
+		return;
+	}
+
+	m_count = count;
+	m_tick = qBound(0, m_settings.frame, m_count - 1);
+	restart();
+	emit opened(m_count);
+}
+
+bool SequencePlayer::show(qint64 tick)
+{
+	Slot& s = slot(tick);
+	if(s.tick != tick || s.state != READY)
+		return false;
+	emit frame_ready(tick % m_count, s.image);
+	return true;
+}
@@ -0,0 +1,144 @@
+#ifndef SEQUENCEPLAYER_H
+#define SEQUENCEPLAYER_H
+
+#include <QObject>
+#include <QImage>
+#include <QTimer>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+
+#include "rawreader.h"
+
+///////////////////////////////////////////////
+/// \brief The SequencePlayer class
+/// playback of file with many frames (RAW_TYPE_2 or stream of RAW_TYPE_1).
+/// frames ahead of playhead are decoded and demoscaled by pool of threads (one RawReader per thread at once,
+/// readers and their buffers are reused by next frames) into ring buffer of fixed size, timer takes them at target fps
+///
+
+class SequencePlayer: public QObject
+{
+	Q_OBJECT
+public:
+	explicit SequencePlayer(QObject* parent = 0);
+	~SequencePlayer();
+	/**
+	 * @brief open
+	 * файл последовательности кадров, размер кадра из settings (RAW_TYPE_2)
+	 * или из индекса кадров (RAW_TYPE_1). индекс строится в пуле потоков,
+	 * результат приходит в opened()
+	 * @param fileName
+	 * @param settings
+	 */
+	void open(const QString& fileName, const RawReader::Settings& settings);
+	void close();
+	/**
+	 * @brief set_settings
+	 * новые параметры: кадры в буфере вычисляются заново
+	 * @param settings
+	 */
+	void set_settings(const RawReader::Settings& settings);
+	int frame_count() const;
+	int position() const;
+	bool is_playing() const;
+	void set_fps(double value);
+	double fps() const;
+	/**
+	 * @brief set_capacity
+	 * size of ring buffer, frames
+	 * @param frames
+	 */
+	void set_capacity(int frames);
+	/**
+	 * @brief late_frames
+	 * ticks of timer when the next frame was not ready
+	 * @return
+	 */
+	int late_frames() const;
+
+	/// reader of decoder, called by task of frame (thread safe)
+	RawReader* take_reader();
+	/// reader is free for next frame
+	void put_reader(RawReader* reader);
+
+public slots:
+	void play();
+	void pause();
+	/**
+	 * @brief seek
+	 * next frame to show; when paused it is shown as soon as it is ready
+	 * @param index
+	 */
+	void seek(int index);
+
+signals:
+	void frame_ready(int index, const QImage& image);
+	/**
+	 * @brief opened
+	 * file of open() is ready for playback
+	 * @param count - number of frames, 0 if file is not a sequence
+	 */
+	void opened(int count);
+
+private slots:
+	void on_tick();
+	void on_indexed(int generation, const FrameIndex& index);
+	void on_decoded(int generation, qint64 tick, const QImage& image);
+
+private:
+	enum STATE{
+		EMPTY,
+		DECODING,
+		READY
+	};
+	/// slot of ring: frame of tick (ticks grow through loops of sequence)
+	struct Slot{
+		qint64 tick;
+		STATE state;
+		QImage image;
+	};
+
+	QString m_fileName;
+	RawReader::Settings m_settings;
+	/// frames, 0 while index is built
+	int m_count;
+	/// frames of RAW_TYPE_1, shared by decoders
+	FrameIndex m_index;
+
+	QVector< Slot > m_ring;
+	/// tick of next frame to show, frame is tick % m_count
+	qint64 m_tick;
+	bool m_show_next;
+	int m_decoding;
+	int m_late;
+
+	QTimer m_timer;
+	double m_fps;
+	/// decoders; results of previous generation (settings, file) are dropped
+	QThreadPool m_pool;
+	QAtomicInt m_generation;
+	/// free readers, not more than threads of pool are created
+	QMutex m_readers_mutex;
+	QList< RawReader* > m_readers;
+
+	Slot& slot(qint64 tick);
+	/**
+	 * @brief schedule
+	 * decoding of frames of ring which are not ready, nearest first,
+	 * not more than threads of pool at once (when playing or frame is requested)
+	 */
+	void schedule();
+	/**
+	 * @brief restart
+	 * new generation: ring is cleared
+	 */
+	void restart();
+	bool show(qint64 tick);
+	/// frames are known: playback starts from frame of settings
+	void start(int count);
+};
+
+#endif // SEQUENCEPLAYER_H
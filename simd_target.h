@@ -0,0 +1,21 @@
+#ifndef SIMD_TARGET_H
+#define SIMD_TARGET_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/// functions of sse2/avx2 are compiled for its instruction set, selection is made at runtime
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_SSE2	__attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2	__attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#endif
+
+#endif // SIMD_TARGET_H
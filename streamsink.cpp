@@ -0,0 +1,57 @@
+#include "streamsink.h"
+
+PpmSink::PpmSink(const QString &fileName)
+	: m_file(fileName)
+	, m_width(0)
+	, m_height(0)
+	, m_rows(0)
+{
+}
+
+bool PpmSink::begin(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_rows = 0;
+	if(width <= 0 || height <= 0 || !m_file.open(QIODevice::WriteOnly))
+		return false;
+
+	const QByteArray header = QString("P6\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+	return m_file.write(header) == header.size();
+}
+
+bool PpmSink::write(const QImage &strip)
+{
+	if(!m_file.isOpen() || strip.width() != m_width || m_rows + strip.height() > m_height)
+		return false;
+
+	const qint64 row = (qint64)m_width * 3;
+	m_buffer.resize((int)(row * strip.height()));
+	uchar* d = reinterpret_cast< uchar* >(m_buffer.data());
+	for(int i = 0; i < strip.height(); ++i){
+		const QRgb* sl = reinterpret_cast< const QRgb* >(strip.constScanLine(i));
+		for(int j = 0; j < m_width; ++j){
+			*d++ = qRed(sl[j]);
+			*d++ = qGreen(sl[j]);
+			*d++ = qBlue(sl[j]);
+		}
+	}
+	if(m_file.write(m_buffer) != m_buffer.size())
+		return false;
+	m_rows += strip.height();
+	return true;
+}
+
+bool PpmSink::end()
+{
+	if(!m_file.isOpen())
+		return false;
+	bool res = m_file.flush() && m_rows == m_height;
+	m_file.close();
+	return res;
+}
+
+int PpmSink::rows() const
+{
+	return m_rows;
+}
@@ -0,0 +1,65 @@
+#ifndef STREAMSINK_H
+#define STREAMSINK_H
+
+#include <QImage>
+#include <QFile>
+#include <QByteArray>
+
+///////////////////////////////////////////////
+/// \brief The StreamSink class
+/// receiver of output of RawReader::stream_raw(): size of image, then strips from top to bottom
+///
+
+class StreamSink
+{
+public:
+	virtual ~StreamSink(){}
+	/**
+	 * @brief begin
+	 * @param width - of whole image
+	 * @param height
+	 * @return false stops streaming
+	 */
+	virtual bool begin(int width, int height) = 0;
+	/**
+	 * @brief write
+	 * @param strip - ARGB32 rows next after previous strip
+	 * @return false stops streaming
+	 */
+	virtual bool write(const QImage& strip) = 0;
+	/**
+	 * @brief end
+	 * after the last strip or after error
+	 * @return false if image is incomplete
+	 */
+	virtual bool end() = 0;
+};
+
+///////////////////////////////////////////////
+/// \brief The PpmSink class
+/// binary PPM (P6, 8 bits by channel): header and rows are written as they come,
+/// so size of image is not limited by memory (QImage can not be more than 2 GB)
+///
+
+class PpmSink: public StreamSink
+{
+public:
+	explicit PpmSink(const QString& fileName);
+
+	virtual bool begin(int width, int height);
+	virtual bool write(const QImage& strip);
+	virtual bool end();
+
+	/// rows written
+	int rows() const;
+
+private:
+	QFile m_file;
+	int m_width;
+	int m_height;
+	int m_rows;
+	/// RGB of strip
+	QByteArray m_buffer;
+};
+
+#endif // STREAMSINK_H
@@ -0,0 +1,155 @@
+#include "tonecurve.h"
+
+#include <math.h>
+#include <algorithm>
+
+/////////////////////////////////
+/// \brief for crpp color value
+#define MAX_UCHAR				(255)
+
+static bool less_x(const QPointF& a, const QPointF& b)
+{
+	return a.x() < b.x();
+}
+
+/////////////////////////////////
+
+ToneCurve::ToneCurve()
+	: m_type(CURVE_LINEAR)
+	, m_shift(4)
+	, m_gamma(2.2)
+	, m_log_scale(100)
+	, m_dirty(true)
+{
+	m_points << QPointF(0, 0) << QPointF(1, 1);
+}
+
+void ToneCurve::set_shift(int shift)
+{
+	shift = qBound(0, shift, 31);
+	if(shift == m_shift)
+		return;
+	m_shift = shift;
+	m_dirty = true;
+}
+
+int ToneCurve::shift() const
+{
+	return m_shift;
+}
+
+void ToneCurve::set_type(ToneCurve::TYPE type)
+{
+	if(type == m_type)
+		return;
+	m_type = type;
+	m_dirty = true;
+}
+
+ToneCurve::TYPE ToneCurve::type() const
+{
+	return m_type;
+}
+
+void ToneCurve::set_gamma(double value)
+{
+	if(value <= 0 || value == m_gamma)
+		return;
+	m_gamma = value;
+	m_dirty = m_dirty || m_type == CURVE_GAMMA;
+}
+
+double ToneCurve::gamma() const
+{
+	return m_gamma;
+}
+
+void ToneCurve::set_log_scale(double value)
+{
+	if(value <= 0 || value == m_log_scale)
+		return;
+	m_log_scale = value;
+	m_dirty = m_dirty || m_type == CURVE_LOG;
+}
+
+double ToneCurve::log_scale() const
+{
+	return m_log_scale;
+}
+
+void ToneCurve::set_points(const QVector<QPointF> &points)
+{
+	if(points.size() < 2)
+		return;
+	m_points = points;
+	std::sort(m_points.begin(), m_points.end(), less_x);
+	m_dirty = m_dirty || m_type == CURVE_POINTS;
+}
+
+QVector<QPointF> ToneCurve::points() const
+{
+	return m_points;
+}
+
+bool ToneCurve::is_shift() const
+{
+	return m_type == CURVE_LINEAR;
+}
+
+void ToneCurve::update()
+{
+	if(!m_dirty && !m_lut.empty())
+		return;
+
+	m_lut.resize(LUT_SIZE + LUT_PADDING);
+
+	if(m_type == CURVE_LINEAR){
+		for(int i = 0; i < LUT_SIZE; ++i){
+			m_lut[i] = qMin(i >> m_shift, MAX_UCHAR);
+		}
+	}else{
+		/// white point: value which is 255 with linear curve
+		const double white = ldexp(MAX_UCHAR, m_shift);
+		for(int i = 0; i < LUT_SIZE; ++i){
+			double x = qMin(1., i / white);
+			m_lut[i] = qBound(0, qRound(apply(x) * MAX_UCHAR), MAX_UCHAR);
+		}
+	}
+	std::fill(m_lut.begin() + LUT_SIZE, m_lut.end(), 0);
+
+	m_dirty = false;
+}
+
+const uchar *ToneCurve::lut() const
+{
+	return &m_lut[0];
+}
+
+double ToneCurve::apply(double x) const
+{
+	switch (m_type) {
+		case CURVE_GAMMA:
+			return pow(x, 1. / m_gamma);
+		case CURVE_SRGB:
+			return x <= 0.0031308? 12.92 * x : 1.055 * pow(x, 1. / 2.4) - 0.055;
+		case CURVE_LOG:
+			return log(1. + m_log_scale * x) / log(1. + m_log_scale);
+		case CURVE_POINTS:
+		{
+			if(x <= m_points.first().x())
+				return m_points.first().y();
+			for(int i = 1; i < m_points.size(); ++i){
+				const QPointF& p0 = m_points[i - 1];
+				const QPointF& p1 = m_points[i];
+				if(x <= p1.x()){
+					double dx = p1.x() - p0.x();
+					return dx > 0? p0.y() + (x - p0.x()) * (p1.y() - p0.y()) / dx : p1.y();
+				}
+			}
+			return m_points.last().y();
+		}
+		case CURVE_LINEAR:
+		default:
+			return x;
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef TONECURVE_H
+#define TONECURVE_H
+
+#include <QVector>
+#include <QPointF>
+
+#include <vector>
+
+///////////////////////////////////////////////
+/// \brief The ToneCurve class
+/// table of conversion of 16-bit value of pixel to 8-bit.
+/// input value is normalized to white point 255 << shift,
+/// so CURVE_LINEAR is the same as min(255, value >> shift)
+///
+
+class ToneCurve
+{
+public:
+	enum TYPE{
+		CURVE_LINEAR,		/// right shift with clamp
+		CURVE_GAMMA,		/// power 1/gamma
+		CURVE_SRGB,			/// sRGB transfer function
+		CURVE_LOG,			/// log(1 + k * x) / log(1 + k)
+		CURVE_POINTS		/// piecewise linear by user points
+	};
+	/// size of table (and padding for vector gather by 32 bit)
+	enum{
+		LUT_SIZE = 65536,
+		LUT_PADDING = 4
+	};
+
+	ToneCurve();
+
+	void set_shift(int shift);
+	int shift() const;
+	void set_type(TYPE type);
+	TYPE type() const;
+	/**
+	 * @brief set_gamma
+	 * gamma for CURVE_GAMMA
+	 * @param value
+	 */
+	void set_gamma(double value);
+	double gamma() const;
+	/**
+	 * @brief set_log_scale
+	 * k for CURVE_LOG
+	 * @param value
+	 */
+	void set_log_scale(double value);
+	double log_scale() const;
+	/**
+	 * @brief set_points
+	 * points (x, y) in range [0, 1] for CURVE_POINTS
+	 * @param points
+	 */
+	void set_points(const QVector< QPointF >& points);
+	QVector< QPointF > points() const;
+	/**
+	 * @brief is_shift
+	 * table is pure right shift with clamp
+	 * @return
+	 */
+	bool is_shift() const;
+	/**
+	 * @brief update
+	 * rebuild table if parameters are changed
+	 */
+	void update();
+	/**
+	 * @brief lut
+	 * table of LUT_SIZE values (valid after update())
+	 * @return
+	 */
+	const uchar* lut() const;
+
+	inline uchar operator()(int value) const{
+		return m_lut[value];
+	}
+
+private:
+	TYPE m_type;
+	int m_shift;
+	double m_gamma;
+	double m_log_scale;
+	QVector< QPointF > m_points;
+	bool m_dirty;
+	std::vector< uchar > m_lut;
+
+	double apply(double x) const;
+};
+
+#endif // TONECURVE_H
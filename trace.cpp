@@ -0,0 +1,130 @@
+#include "trace.h"
+
+#include <QThread>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+Trace::Trace()
+{
+	m_timer.start();
+}
+
+void Trace::clear()
+{
+	QMutexLocker lock(&m_mutex);
+	m_events.clear();
+	m_threads.clear();
+	m_timer.restart();
+}
+
+qint64 Trace::now() const
+{
+	return m_timer.nsecsElapsed() / 1000;
+}
+
+void Trace::add(const QString &name, const char *category, qint64 start, qint64 duration)
+{
+	QMutexLocker lock(&m_mutex);
+
+	Qt::HANDLE id = QThread::currentThreadId();
+	if(!m_threads.contains(id)){
+		int index = m_threads.size();
+		m_threads[id] = index;
+	}
+
+	Event ev = { name, category, start, duration, m_threads[id] };
+	m_events.push_back(ev);
+}
+
+QVector<Trace::Event> Trace::events() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_events;
+}
+
+QString Trace::summary() const
+{
+	QVector< Event > events = this->events();
+
+	QStringList names;
+	QHash< QString, qint64 > sums;
+	foreach (const Event& ev, events) {
+		if(qstrcmp(ev.category, "stage") != 0)
+			continue;
+		if(!sums.contains(ev.name))
+			names << ev.name;
+		sums[ev.name] += ev.duration;
+	}
+
+	QStringList res;
+	foreach (const QString& name, names) {
+		res << QString("%1 %2 ms").arg(name).arg(sums[name] / 1000., 0, 'f', 1);
+	}
+	return res.join(" | ");
+}
+
+QByteArray Trace::to_json() const
+{
+	QVector< Event > events = this->events();
+
+	QJsonArray list;
+	int threads = 0;
+	foreach (const Event& ev, events) {
+		QJsonObject obj;
+		obj["name"] = ev.name;
+		obj["cat"] = QString(ev.category);
+		obj["ph"] = QString("X");
+		obj["ts"] = ev.start;
+		obj["dur"] = ev.duration;
+		obj["pid"] = 1;
+		obj["tid"] = ev.thread;
+		list.append(obj);
+		threads = qMax(threads, ev.thread + 1);
+	}
+	/// names of threads: first thread is the caller of job
+	for(int i = 0; i < threads; ++i){
+		QJsonObject args;
+		args["name"] = i? QString("worker %1").arg(i) : QString("job");
+		QJsonObject obj;
+		obj["name"] = QString("thread_name");
+		obj["ph"] = QString("M");
+		obj["pid"] = 1;
+		obj["tid"] = i;
+		obj["args"] = args;
+		list.append(obj);
+	}
+
+	QJsonObject root;
+	root["traceEvents"] = list;
+	root["displayTimeUnit"] = QString("ms");
+
+	return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool Trace::save(const QString &fileName) const
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly))
+		return false;
+	file.write(to_json());
+	file.close();
+	return true;
+}
+
+/////////////////////////////////
+
+ScopedTimer::ScopedTimer(Trace *trace, const QString &name, const char *category)
+	: m_trace(trace)
+	, m_name(name)
+	, m_category(category)
+	, m_start(trace? trace->now() : 0)
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	if(m_trace)
+		m_trace->add(m_name, m_category, m_start, m_trace->now() - m_start);
+}
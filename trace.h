@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QByteArray>
+
+///////////////////////////////////////////////
+/// \brief The Trace class
+/// timings of stages of one job (thread safe).
+/// can be saved as json of chrome://tracing and Perfetto
+///
+
+class Trace
+{
+public:
+	struct Event{
+		QString name;
+		const char* category;	/// "stage", "thread", "job"
+		qint64 start;			/// us from clear()
+		qint64 duration;		/// us
+		int thread;				/// index of thread in order of first event
+	};
+
+	Trace();
+	/**
+	 * @brief clear
+	 * begin of new job: events are removed, time is counted from zero
+	 */
+	void clear();
+	/**
+	 * @brief now
+	 * time from clear(), us
+	 * @return
+	 */
+	qint64 now() const;
+	void add(const QString& name, const char* category, qint64 start, qint64 duration);
+	QVector< Event > events() const;
+	/**
+	 * @brief summary
+	 * sum of durations of stages by name, e.g. "read 10.1 ms | linear 5.2 ms"
+	 * @return
+	 */
+	QString summary() const;
+	/**
+	 * @brief to_json
+	 * trace event format (complete events "X" and names of threads)
+	 * @return
+	 */
+	QByteArray to_json() const;
+	bool save(const QString& fileName) const;
+
+private:
+	mutable QMutex m_mutex;
+	QElapsedTimer m_timer;
+	QVector< Event > m_events;
+	QHash< Qt::HANDLE, int > m_threads;
+};
+
+///////////////////////////////////////////////
+/// \brief The ScopedTimer class
+/// event from constructor to destructor. trace may be null
+///
+
+class ScopedTimer
+{
+public:
+	ScopedTimer(Trace* trace, const QString& name, const char* category = "stage");
+	~ScopedTimer();
+
+private:
+	Trace* m_trace;
+	QString m_name;
+	const char* m_category;
+	qint64 m_start;
+};
+
+#endif // TRACE_H